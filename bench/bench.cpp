@@ -0,0 +1,52 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<bool> tracking{false};
+std::atomic<uint64_t> alloc_count{0};
+std::atomic<uint64_t> alloc_bytes{0};
+
+void* counted_alloc(size_t size) {
+  if (tracking.load(std::memory_order_relaxed)) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  if (void* ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace bench {
+
+alloc_counters alloc_snapshot() {
+  return {alloc_count.load(), alloc_bytes.load()};
+}
+
+void track_allocs(bool enabled) {
+  tracking.store(enabled);
+}
+
+void print_header() {
+  std::printf("%-28s %-36s %14s %10s %14s\n", "benchmark", "params", "ns/op", "allocs/op", "alloc B/op");
+}
+
+void print_row(const std::string& name, const std::string& params, const result& res) {
+  std::printf("%-28s %-36s %14.1f %10.2f %14.0f\n", name.c_str(), params.c_str(),
+              res.ns_per_op, res.allocs_per_op, res.bytes_per_op);
+  std::fflush(stdout);
+}
+
+}
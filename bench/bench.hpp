@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Heap counters maintained by the operator new/delete replacements in
+// bench.cpp. Only allocations made while tracking is enabled are counted.
+struct alloc_counters {
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+};
+
+alloc_counters alloc_snapshot();
+void track_allocs(bool enabled);
+
+struct result {
+  double ns_per_op = 0;
+  double allocs_per_op = 0;
+  double bytes_per_op = 0;
+};
+
+// Runs `op` on `batch` fresh inputs per round. Inputs are produced by
+// `setup(i)` outside of the timed and tracked region, so copying large
+// interval sets into place does not pollute the numbers. Reports the
+// median round.
+template<typename Setup, typename Op>
+result measure(size_t batch, size_t rounds, Setup setup, Op op) {
+  using clock = std::chrono::steady_clock;
+  using input = decltype(setup(size_t{0}));
+
+  std::vector<result> samples;
+  samples.reserve(rounds);
+  for (size_t r = 0; r < rounds; ++r) {
+    std::vector<input> inputs;
+    inputs.reserve(batch);
+    for (size_t i = 0; i < batch; ++i)
+      inputs.push_back(setup(i));
+
+    auto before = alloc_snapshot();
+    track_allocs(true);
+    auto start = clock::now();
+    for (auto& in: inputs)
+      op(in);
+    auto stop = clock::now();
+    track_allocs(false);
+    auto after = alloc_snapshot();
+
+    double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    samples.push_back({ns / batch,
+                       double(after.allocs - before.allocs) / batch,
+                       double(after.bytes - before.bytes) / batch});
+  }
+
+  std::sort(samples.begin(), samples.end(), [](const auto& a, const auto& b){
+    return a.ns_per_op < b.ns_per_op;
+  });
+  return samples[samples.size() / 2];
+}
+
+// Number of inputs per round so that a round touches roughly `budget`
+// elements in total.
+inline size_t batch_for(size_t elements, size_t budget = 4000000, size_t cap = 1000) {
+  return std::max<size_t>(1, std::min(cap, budget / std::max<size_t>(1, elements)));
+}
+
+void print_header();
+void print_row(const std::string& name, const std::string& params, const result& res);
+
+// Keeps the optimizer from discarding a computed value.
+template<typename T>
+inline void do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}
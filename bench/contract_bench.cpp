@@ -0,0 +1,273 @@
+// Replays synthetic traces against the host build of ertc and ertc.nft and
+// reports throughput, latency percentiles and database traffic per action.
+// Usage: contract_bench [scale] [seed] [console file]
+//
+// Phases:
+//   issue    validations issued in one action, as a block or as packed
+//            cells, or through planpolygon / issuestep, each paid out to
+//            its creator and the fund account
+//   p2p      peer-to-peer transfers by id, by id ranges and by amount that
+//            fragment the holders' ids
+//   payout   more validations paid out into the now large, fragmented fund
+//
+// The contracts' console output goes to the console file when one is given,
+// with -DERTC_INSTRUMENT=ON that is the input of instr_report.
+
+#include <contracts.hpp>
+#include <ertc.hpp>
+#include <ertc.nft.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using eosio::name;
+using eosio::asset;
+using eosio::symbol;
+
+const name NFT = "ertc.nft"_n;
+const name ERTC = "ertc"_n;
+const name FUND = "ertc.fund"_n;
+const symbol SYM{"ERTC", 0};
+
+struct action_stats {
+  std::vector<double> latency_ns;
+  sim::counters traffic;
+};
+
+struct phase_stats {
+  std::map<std::string, action_stats> actions;
+  uint64_t failures = 0;
+  double total_ns = 0;
+  uint64_t executed = 0;      // inline actions included
+};
+
+std::mt19937_64 rng;
+phase_stats* current = nullptr;
+FILE* console = nullptr;
+
+// Pushes one action as a transaction and books its time and row traffic
+// under its name. Returns false when the contract rejected it.
+bool run(name account, name act, name actor, const std::vector<char>& data, bool may_fail = false) {
+  eosio::action a;
+  a.account = account;
+  a.name = act;
+  a.authorization = {{actor, "active"_n}};
+  a.data = data;
+
+  auto before = sim::get_counters();
+  auto start = std::chrono::steady_clock::now();
+  try {
+    sim::push_action(a);
+  } catch (const std::exception& e) {
+    sim::take_console();
+    if (!may_fail) {
+      ++current->failures;
+      std::fprintf(stderr, "%s::%s failed: %s\n", account.to_string().c_str(), act.to_string().c_str(), e.what());
+    }
+    return false;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  const auto& after = sim::get_counters();
+  auto printed = sim::take_console();
+  if (console)
+    std::fputs(printed.c_str(), console);
+
+  auto& s = current->actions[account.to_string() + "::" + act.to_string()];
+  s.latency_ns.push_back(ns);
+  s.traffic.rows_read += after.rows_read - before.rows_read;
+  s.traffic.bytes_read += after.bytes_read - before.bytes_read;
+  s.traffic.rows_written += after.rows_written - before.rows_written;
+  s.traffic.bytes_written += after.bytes_written - before.bytes_written;
+  s.traffic.rows_erased += after.rows_erased - before.rows_erased;
+  s.traffic.index_writes += after.index_writes - before.index_writes;
+  current->total_ns += ns;
+  current->executed += after.actions - before.actions;
+  return true;
+}
+
+template<typename... Args>
+bool push(name account, name act, name actor, const Args&... args) {
+  return run(account, act, actor, eosio::pack(std::make_tuple(args...)));
+}
+
+// Ids `owner` holds, read straight from its pages outside of any action.
+interval_set holdings(name owner) {
+  ertc::nft::page_index pages(NFT, owner.value);
+  auto by_start = pages.get_index<"bystart"_n>();
+  interval_set result;
+  for (const auto& pg: by_start) {
+    auto ids = decode_intervals(pg.tokens);
+    result.insert(result.end(), ids.begin(), ids.end());
+  }
+  return result;
+}
+
+int64_t count_ids(const interval_set& ids) {
+  int64_t n = 0;
+  for (const auto& range: ids)
+    n += range.second - range.first + 1;
+  return n;
+}
+
+id_type nth_id(const interval_set& ids, int64_t n) {
+  for (const auto& range: ids) {
+    int64_t len = range.second - range.first + 1;
+    if (n < len)
+      return range.first + n;
+    n -= len;
+  }
+  return ids.back().second;
+}
+
+std::vector<name> users;
+uint64_t next_validation = 1;
+
+// One validation over a height x width rectangle of its own, issued the
+// way `kind` says and paid out.
+void validation_flow(int kind, int64_t height, int64_t width) {
+  uint64_t id = next_validation++;
+  int64_t row = int64_t(id / 32) * 4096, col = int64_t(id % 32) * 4096;
+  std::vector<point> polygon{{row, col}, {row, col + width}, {row + height, col + width}, {row + height, col}};
+  int64_t amount = height * width;
+  name creator = users[rng() % users.size()];
+
+  push(ERTC, "create"_n, creator, creator, id, polygon, amount);
+  push(ERTC, "approve"_n, ERTC, id);
+  push(ERTC, "preissue"_n, ERTC, id);
+  if (kind == 0) {
+    std::vector<points_pair> areas{{{row, col}, {row + height - 1, col + width - 1}}};
+    push(ERTC, "issuerect"_n, ERTC, id, amount, areas);
+  } else if (kind == 1) {
+    packed_points cells;
+    points_encoder encoder(cells);
+    for (int64_t r = row; r < row + height; ++r)
+      for (int64_t c = col; c < col + width; ++c)
+        encoder.push({r, c});
+    encoder.finish();
+    push(ERTC, "issuepacked"_n, ERTC, id, amount, cells);
+  } else {
+    push(ERTC, "planpolygon"_n, ERTC, id);
+    while (run(ERTC, "issuestep"_n, ERTC, eosio::pack(std::make_tuple(id)), true));
+  }
+  push(ERTC, "payout"_n, ERTC, id);
+}
+
+void issue_phase(size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    int64_t side = 4 + rng() % 40;
+    validation_flow(i % 3, side, side + rng() % 20);
+  }
+}
+
+void p2p_phase(size_t count) {
+  std::vector<name> holders(users);
+  holders.push_back(FUND);
+  for (size_t i = 0; i < count; ++i) {
+    name from = holders[rng() % holders.size()];
+    name to = users[rng() % users.size()];
+    if (from == to)
+      continue;
+    auto held = holdings(from);
+    int64_t total = count_ids(held);
+    if (total == 0)
+      continue;
+
+    switch (rng() % 3) {
+    case 0:
+      push(NFT, "transferid"_n, from, from, to, nth_id(held, rng() % total), std::string());
+      break;
+    case 1: {
+      // a few short ranges spread over the holder's ids
+      interval_set ids;
+      int64_t at = rng() % total;
+      for (int k = 0; k < 4 && at < total; ++k) {
+        id_type first = nth_id(held, at);
+        auto range = std::lower_bound(held.begin(), held.end(), first, [](const id_pair& r, id_type id){ return r.second < id; });
+        id_type last = std::min<id_type>(range->second, first + rng() % 8);
+        ids.push_back({first, last});
+        at += int64_t(last - first) + 2 + rng() % 50;
+      }
+      push(NFT, "transferids"_n, from, from, to, asset{count_ids(ids), SYM}, ids, std::string());
+      break;
+    }
+    default:
+      push(NFT, "transfer"_n, from, from, to, asset{1 + int64_t(rng() % std::min<int64_t>(total, 30)), SYM}, std::string());
+    }
+  }
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+  return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+void report(const char* phase, phase_stats& stats) {
+  size_t pushed = 0;
+  for (const auto& entry: stats.actions)
+    pushed += entry.second.latency_ns.size();
+  std::printf("\n%s: %zu transactions, %lu actions executed in %.1f ms, %.0f tx/s, %.0f actions/s, %lu failures\n",
+              phase, pushed, stats.executed, stats.total_ns / 1e6,
+              pushed / (stats.total_ns / 1e9), stats.executed / (stats.total_ns / 1e9), stats.failures);
+  std::printf("%-24s %7s %10s %10s %10s %10s %9s %9s %11s %11s\n",
+              "action", "count", "p50 us", "p90 us", "p99 us", "max us", "rows rd", "rows wr", "bytes rd", "bytes wr");
+  for (auto& [act, s]: stats.actions) {
+    auto& lat = s.latency_ns;
+    std::sort(lat.begin(), lat.end());
+    double n = double(lat.size());
+    std::printf("%-24s %7zu %10.1f %10.1f %10.1f %10.1f %9.1f %9.1f %11.0f %11.0f\n",
+                act.c_str(), lat.size(), percentile(lat, 0.5) / 1e3, percentile(lat, 0.9) / 1e3,
+                percentile(lat, 0.99) / 1e3, lat.back() / 1e3,
+                s.traffic.rows_read / n, s.traffic.rows_written / n,
+                s.traffic.bytes_read / n, s.traffic.bytes_written / n);
+  }
+  std::fflush(stdout);
+}
+
+}
+
+int main(int argc, char** argv) {
+  size_t scale = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1;
+  rng.seed(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1);
+  if (argc > 3 && !(console = std::fopen(argv[3], "w"))) {
+    std::perror(argv[3]);
+    return 1;
+  }
+
+  sim::deploy_nft(NFT);
+  sim::deploy_ertc(ERTC);
+  sim::create_account(FUND);
+  for (size_t i = 0; i < 20 * scale; ++i) {
+    std::string account = "user";
+    for (size_t n = i; account.size() < 12; n /= 5)
+      account += char('a' + n % 5);
+    users.push_back(name(account));
+    sim::create_account(users.back());
+  }
+
+  phase_stats setup, issue, p2p, payout;
+  current = &setup;
+  push(NFT, "create"_n, NFT, ERTC, std::string("ERTC"));
+
+  current = &issue;
+  issue_phase(30 * scale);
+  report("issue", issue);
+
+  current = &p2p;
+  p2p_phase(2000 * scale);
+  report("p2p", p2p);
+
+  current = &payout;
+  issue_phase(30 * scale);
+  report("payout", payout);
+
+  if (console)
+    std::fclose(console);
+  return issue.failures + p2p.failures + payout.failures ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+// Aggregates the "#instr" records printed by contracts built with
+// ERTC_INSTRUMENT: per action the number of records, and the mean and
+// maximum of every counter. Other console lines are skipped.
+// Usage: instr_report < console.log
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct field_stats {
+  uint64_t sum = 0;
+  uint64_t max = 0;
+};
+
+struct action_stats {
+  uint64_t records = 0;
+  std::vector<std::pair<std::string, field_stats>> fields;   // in record order
+
+  field_stats& field(const std::string& key) {
+    auto it = std::find_if(fields.begin(), fields.end(), [&](const auto& f){ return f.first == key; });
+    if (it != fields.end())
+      return it->second;
+    fields.push_back({key, {}});
+    return fields.back().second;
+  }
+};
+
+}
+
+int main() {
+  std::map<std::string, action_stats> actions;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    auto at = line.find("#instr ");
+    if (at == std::string::npos)
+      continue;
+    std::istringstream in(line.substr(at + 7));
+    std::string action, pair;
+    in >> action;
+    auto& stats = actions[action];
+    ++stats.records;
+    while (in >> pair) {
+      auto eq = pair.find('=');
+      if (eq == std::string::npos)
+        continue;
+      uint64_t value = std::strtoull(pair.c_str() + eq + 1, nullptr, 10);
+      auto& f = stats.field(pair.substr(0, eq));
+      f.sum += value;
+      f.max = std::max(f.max, value);
+    }
+  }
+
+  for (const auto& [action, stats]: actions) {
+    std::printf("\n%s: %lu records\n", action.c_str(), stats.records);
+    std::printf("  %-16s %14s %14s\n", "counter", "mean", "max");
+    for (const auto& [key, f]: stats.fields)
+      std::printf("  %-16s %14.1f %14lu\n", key.c_str(), double(f.sum) / stats.records, f.max);
+  }
+  return 0;
+}
@@ -0,0 +1,456 @@
+// Microbenchmarks for the prange interval routines that run on every
+// nft::issue / nft::transfer. Usage: prange_bench [filter]
+
+#include "bench.hpp"
+#include <prange.hpp>
+#include <packed_set.hpp>
+#include <interval_lookup.hpp>
+#include <morton.hpp>
+#include <raster.hpp>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace {
+
+constexpr id_type BASE_ID = 1000;
+constexpr id_type INTERVAL_LEN = 4;
+constexpr id_type INTERVAL_GAP = 4;
+
+const size_t SET_SIZES[] = {1, 100, 10000, 1000000};
+
+// `count` intervals of INTERVAL_LEN ids separated by INTERVAL_GAP free ids,
+// i.e. a holder whose ids are fragmented into `count` pieces.
+interval_set make_set(size_t count) {
+  interval_set result;
+  result.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    id_type first = BASE_ID + i * (INTERVAL_LEN + INTERVAL_GAP);
+    result.push_back({first, first + INTERVAL_LEN - 1});
+  }
+  return result;
+}
+
+enum class shape { coalescing, disjoint, append };
+
+const char* shape_name(shape s) {
+  switch (s) {
+    case shape::coalescing: return "coalescing";
+    case shape::disjoint:   return "disjoint";
+    default:                return "append";
+  }
+}
+
+// `count` incoming intervals spread evenly over the gaps of a set built by
+// make_set(set_size). Coalescing intervals fill a gap completely and join
+// both neighbours, disjoint ones sit inside the gap touching neither.
+// Appended ones follow the last interval like freshly issued ids do.
+interval_set make_incoming(size_t set_size, size_t count, shape kind) {
+  interval_set result;
+  result.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    size_t gap = kind == shape::append ? set_size - 1 + i : i * set_size / count;
+    id_type end = BASE_ID + gap * (INTERVAL_LEN + INTERVAL_GAP) + INTERVAL_LEN - 1;
+    if (kind == shape::disjoint)
+      result.push_back({end + 2, end + INTERVAL_GAP - 1});
+    else
+      result.push_back({end + 1, end + INTERVAL_GAP});
+  }
+  return result;
+}
+
+std::string params(size_t intervals, const std::string& extra) {
+  return "n=" + std::to_string(intervals) + " " + extra;
+}
+
+bool selected(const char* filter, const std::string& name) {
+  return !filter || name.find(filter) != std::string::npos;
+}
+
+void bench_merge_sets(const char* filter) {
+  const std::string name = "merge_sets";
+  if (!selected(filter, name)) return;
+
+  for (size_t n: SET_SIZES) {
+    auto base = make_set(n);
+    std::vector<size_t> counts;
+    for (size_t k: {size_t(1), size_t(100), n})
+      if (k <= n && std::find(counts.begin(), counts.end(), k) == counts.end())
+        counts.push_back(k);
+
+    for (size_t k: counts) {
+      for (shape kind: {shape::coalescing, shape::disjoint, shape::append}) {
+        auto incoming = make_incoming(n, k, kind);
+        auto res = bench::measure(bench::batch_for(n + k), 5,
+          [&](size_t){ return base; },
+          [&](interval_set& set){
+            merge_sets(set, incoming.begin(), incoming.end());
+            bench::do_not_optimize(set.data());
+          });
+        bench::print_row(name, params(n, "k=" + std::to_string(k) + " " + shape_name(kind)), res);
+      }
+    }
+  }
+}
+
+void bench_insert_interval(const char* filter) {
+  const std::string name = "insert_interval";
+  if (!selected(filter, name)) return;
+
+  for (size_t n: SET_SIZES) {
+    auto base = make_set(n);
+    // middle gap, bridging both neighbours or standing alone
+    for (bool coalescing: {true, false}) {
+      auto incoming = make_incoming(n, 1, coalescing ? shape::coalescing : shape::disjoint).front();
+      size_t middle = n / 2;
+      incoming.first += middle * (INTERVAL_LEN + INTERVAL_GAP);
+      incoming.second += middle * (INTERVAL_LEN + INTERVAL_GAP);
+      if (coalescing) {
+        // overlap both neighbours so they collapse into one interval
+        --incoming.first;
+        ++incoming.second;
+      }
+      auto res = bench::measure(bench::batch_for(n), 5,
+        [&](size_t){ return base; },
+        [&](interval_set& set){
+          bench::do_not_optimize(insert_interval(set, incoming));
+        });
+      bench::print_row(name, params(n, coalescing ? "overlapping" : "disjoint"), res);
+    }
+  }
+}
+
+void bench_substract_amount(const char* filter) {
+  const std::string name = "substract_amount";
+  if (!selected(filter, name)) return;
+
+  for (size_t n: SET_SIZES) {
+    auto base = make_set(n);
+    int64_t total = n * INTERVAL_LEN;
+    const std::pair<const char*, int64_t> amounts[] = {
+      {"amount=1", 1},
+      {"amount=len+2", int64_t(INTERVAL_LEN + 2)},
+      {"amount=100*len", int64_t(100 * INTERVAL_LEN)},
+      {"amount=half", total / 2},
+    };
+    for (const auto& amount: amounts) {
+      if (amount.second < 1 || amount.second >= total) continue;
+      auto res = bench::measure(bench::batch_for(n), 5,
+        [&](size_t){ return base; },
+        [&](interval_set& set){
+          auto taken = substract_amount(set, amount.second);
+          bench::do_not_optimize(taken.data());
+        });
+      bench::print_row(name, params(n, amount.first), res);
+    }
+  }
+}
+
+// Bulk transfers out of a heavily fragmented holder: the cost should grow
+// linearly with the number of intervals taken.
+void bench_substract_scaling(const char* filter) {
+  const std::string name = "substract_amount_scaling";
+  if (!selected(filter, name)) return;
+
+  const size_t n = 1000000;
+  auto base = make_set(n);
+  for (size_t taken: {size_t(10), size_t(100), size_t(1000), size_t(10000), size_t(100000), n / 2}) {
+    // whole intervals plus a split of the next one
+    int64_t amount = taken * INTERVAL_LEN + 1;
+    auto res = bench::measure(bench::batch_for(n), 5,
+      [&](size_t){ return base; },
+      [&](interval_set& set){
+        auto result = substract_amount(set, amount);
+        bench::do_not_optimize(result.data());
+      });
+    bench::print_row(name, params(n, "taken=" + std::to_string(taken)), res);
+  }
+}
+
+// Taking one id out of the middle of a holder's set, as transferid does:
+// remove_id against the general remove_sets pass.
+void bench_remove_id(const char* filter) {
+  const std::string name = "remove_id";
+  if (!selected(filter, name)) return;
+
+  for (size_t n: SET_SIZES) {
+    auto base = make_set(n);
+    const auto& middle = base[n / 2];
+    const std::pair<const char*, id_type> ids[] = {
+      {"edge", middle.first},
+      {"split", middle.first + 1},
+    };
+    for (const auto& id: ids) {
+      interval_set one{{id.second, id.second}};
+      auto single = bench::measure(bench::batch_for(n), 5,
+        [&](size_t){ return base; },
+        [&](interval_set& set){
+          bench::do_not_optimize(remove_id(set, id.second));
+        });
+      bench::print_row(name, params(n, std::string(id.first) + " remove_id"), single);
+      auto general = bench::measure(bench::batch_for(n), 5,
+        [&](size_t){ return base; },
+        [&](interval_set& set){
+          bench::do_not_optimize(remove_sets(set, one.cbegin(), one.cend()));
+        });
+      bench::print_row(name, params(n, std::string(id.first) + " remove_sets"), general);
+    }
+  }
+}
+
+// The interval work of nft::transfer between two small holders: the
+// sender's page is decoded, the amount taken off its back and the page
+// re-encoded, then the ids are merged into the receiver's page. Small sets
+// stay in the interval_set itself, so mostly the packed rows allocate.
+void bench_small_transfer(const char* filter) {
+  const std::string name = "small_transfer";
+  if (!selected(filter, name)) return;
+
+  struct pages {
+    packed_interval_set from;
+    packed_interval_set to;
+  };
+  for (size_t n: {size_t(1), size_t(2), size_t(3), size_t(8)}) {
+    auto held = make_set(n);
+    auto base = pages{encode_intervals(held.cbegin(), held.cend()), {}};
+    base.to = encode_intervals(held.cbegin(), held.cbegin() + 1);
+    auto res = bench::measure(1000, 5,
+      [&](size_t){ return base; },
+      [&](pages& p){
+        auto ids = decode_intervals(p.from);
+        auto taken = substract_amount(ids, 2);
+        p.from = encode_intervals(ids.cbegin(), ids.cend());
+        merge_sets(p.to, taken.cbegin(), taken.cend());
+        bench::do_not_optimize(p.to.data.data());
+      });
+    bench::print_row(name, params(n, "amount=2"), res);
+  }
+}
+
+// Checking many ids against one holder's set: upper_bound over the
+// pairs, as the contracts do, against interval_lookup one id at a time and
+// in batches. ns/op is per id.
+void bench_membership(const char* filter) {
+  const std::string name = "membership";
+  if (!selected(filter, name)) return;
+
+  const size_t queries = 100000;
+  for (size_t n: SET_SIZES) {
+    auto set = make_set(n);
+    interval_lookup lookup(set);
+
+    std::mt19937_64 rng(n);
+    std::vector<id_type> ids(queries);
+    id_type span = n * (INTERVAL_LEN + INTERVAL_GAP);
+    for (auto& id: ids)
+      id = BASE_ID + rng() % span;
+    std::unique_ptr<bool[]> found(new bool[queries]);
+
+    auto per_id = [&](bench::result res){
+      res.ns_per_op /= queries;
+      res.allocs_per_op /= queries;
+      res.bytes_per_op /= queries;
+      return res;
+    };
+    auto searched = bench::measure(1, 5, [](size_t){ return 0; }, [&](int){
+      for (size_t i = 0; i < queries; ++i) {
+        auto it = std::upper_bound(set.begin(), set.end(), ids[i], [](id_type a, const id_pair& b){
+          return a < b.first;
+        });
+        found[i] = it != set.begin() && std::prev(it)->second >= ids[i];
+      }
+      bench::do_not_optimize(found.get());
+    });
+    bench::print_row(name, params(n, "upper_bound"), per_id(searched));
+
+    auto single = bench::measure(1, 5, [](size_t){ return 0; }, [&](int){
+      for (size_t i = 0; i < queries; ++i)
+        found[i] = lookup.contains(ids[i]);
+      bench::do_not_optimize(found.get());
+    });
+    bench::print_row(name, params(n, "lookup"), per_id(single));
+
+    auto batched = bench::measure(1, 5, [](size_t){ return 0; }, [&](int){
+      lookup.contains(ids.data(), queries, found.get());
+      bench::do_not_optimize(found.get());
+    });
+    bench::print_row(name, params(n, "lookup batch"), per_id(batched));
+  }
+}
+
+// The packed row format: encoded size next to the 16 bytes per interval of
+// interval_set, and the cost of the operations add_balance / sub_balance
+// run on it.
+void bench_packed(const char* filter) {
+  const std::string name = "packed";
+  if (!selected(filter, name)) return;
+
+  for (size_t n: SET_SIZES) {
+    auto ids = make_set(n);
+    auto base = encode_intervals(ids.begin(), ids.end());
+    std::string size = "bytes=" + std::to_string(base.data.size()) + "/" + std::to_string(n * sizeof(id_pair));
+
+    auto res = bench::measure(bench::batch_for(n), 5,
+      [&](size_t){ return 0; },
+      [&](int&){
+        auto packed = encode_intervals(ids.begin(), ids.end());
+        bench::do_not_optimize(packed.data.data());
+      });
+    bench::print_row(name + "_encode", params(n, size), res);
+
+    res = bench::measure(bench::batch_for(n), 5,
+      [&](size_t){ return 0; },
+      [&](int&){
+        bench::do_not_optimize(intervals_amount(base));
+      });
+    bench::print_row(name + "_iterate", params(n, size), res);
+
+    auto incoming = make_incoming(n, 1, shape::append);
+    res = bench::measure(bench::batch_for(n), 5,
+      [&](size_t){ return base; },
+      [&](packed_interval_set& set){
+        merge_sets(set, incoming.begin(), incoming.end());
+        bench::do_not_optimize(set.data.data());
+      });
+    bench::print_row(name + "_merge_sets", params(n, "k=1 append"), res);
+
+    if (n * INTERVAL_LEN > INTERVAL_LEN + 2) {
+      res = bench::measure(bench::batch_for(n), 5,
+        [&](size_t){ return base; },
+        [&](packed_interval_set& set){
+          auto taken = substract_amount(set, INTERVAL_LEN + 2);
+          bench::do_not_optimize(taken.data());
+        });
+      bench::print_row(name + "_substract_amount", params(n, "amount=len+2"), res);
+    }
+  }
+}
+
+// "Which tokens are in this box" over a sorted key index, as bycoords
+// (latitude, then longitude) and as the zorder table. Reports the index
+// entries each scan visits next to its time.
+void bench_box_query(const char* filter) {
+  const std::string name = "box_query";
+  if (!selected(filter, name)) return;
+
+  const int64_t side = 1000;
+  std::vector<zkey_type> by_lat, by_z;
+  for (int64_t lat = 0; lat < side; ++lat)
+    for (int64_t lon = 0; lon < side; ++lon) {
+      by_lat.push_back(zkey_type(lat) << 64 | zkey_type(lon));
+      by_z.push_back(morton_key({lat, lon}));
+    }
+  std::sort(by_z.begin(), by_z.end());
+
+  for (int64_t box_side: {int64_t(10), int64_t(100)}) {
+    points_pair box{{side / 2, side / 3}, {side / 2 + box_side - 1, side / 3 + box_side - 1}};
+
+    auto scan_lat = [&]{
+      size_t visited = 0;
+      auto first = std::lower_bound(by_lat.begin(), by_lat.end(), zkey_type(box.first.latitude) << 64 | zkey_type(box.first.longitude));
+      auto last = std::upper_bound(by_lat.begin(), by_lat.end(), zkey_type(box.second.latitude) << 64 | zkey_type(box.second.longitude));
+      for (auto it = first; it != last; ++it) {
+        uint64_t lon = uint64_t(*it);
+        bench::do_not_optimize(lon);
+        ++visited;
+      }
+      return visited;
+    };
+    auto scan_z = [&]{
+      size_t visited = 0;
+      for (const auto& range: morton_ranges(box)) {
+        auto first = std::lower_bound(by_z.begin(), by_z.end(), range.first);
+        auto last = std::upper_bound(first, by_z.end(), range.second);
+        for (auto it = first; it != last; ++it) {
+          auto pt = morton_point(*it);
+          bench::do_not_optimize(pt);
+          ++visited;
+        }
+      }
+      return visited;
+    };
+
+    std::string size = "box=" + std::to_string(box_side) + "^2";
+    auto res = bench::measure(100, 5, [&](size_t){ return 0; }, [&](int&){ bench::do_not_optimize(scan_lat()); });
+    bench::print_row(name + "_latitude", params(by_lat.size(), size + " visited=" + std::to_string(scan_lat())), res);
+    res = bench::measure(100, 5, [&](size_t){ return 0; }, [&](int&){ bench::do_not_optimize(scan_z()); });
+    bench::print_row(name + "_zorder", params(by_z.size(), size + " visited=" + std::to_string(scan_z())), res);
+  }
+}
+
+// Cells of a polygon checked one at a time, each against every edge, with
+// the same centre rule as cells_inside.
+bool ray_cast_inside(const std::vector<point>& polygon, const std::vector<point>& cells) {
+  for (const auto& c: cells) {
+    bool inside = false;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+      point a = polygon[i], b = polygon[(i + 1) % polygon.size()];
+      if (a.latitude > b.latitude)
+        std::swap(a, b);
+      if (c.latitude < a.latitude || c.latitude >= b.latitude)
+        continue;
+      __int128 dy = b.latitude - a.latitude, dx = b.longitude - a.longitude;
+      if (__int128(2 * c.longitude + 1) * dy >= 2 * a.longitude * dy + (2 * (c.latitude - a.latitude) + 1) * dx)
+        inside = !inside;
+    }
+    if (!inside)
+      return false;
+  }
+  return true;
+}
+
+// Checking an issue batch of 5000 cells against validation polygons of
+// growing size: a ray cast per cell against cells_inside sweeping rows.
+void bench_point_in_polygon(const char* filter) {
+  const std::string name = "point_in_polygon";
+  if (!selected(filter, name)) return;
+
+  const size_t batch = 5000;
+  const double radius = 2000;
+  std::mt19937_64 rng(1);
+  for (size_t vertices: {size_t(4), size_t(100), size_t(1000), size_t(10000)}) {
+    // a wavy outline with some noise on every vertex, like a surveyed area
+    std::vector<point> polygon;
+    std::uniform_real_distribution<double> noise(-0.01, 0.01);
+    for (size_t i = 0; i < vertices; ++i) {
+      double angle = 2 * M_PI * i / vertices;
+      double r = radius * (0.8 + 0.15 * std::sin(7 * angle) + noise(rng));
+      polygon.push_back({int64_t(std::lround(r * std::sin(angle))), int64_t(std::lround(r * std::cos(angle)))});
+    }
+
+    auto spans = rasterize_polygon(polygon);
+    std::vector<point> cells;
+    for (size_t i = 0; i < batch; ++i) {
+      const auto& span = spans[rng() % spans.size()];
+      uint64_t width = uint64_t(span.second.longitude - span.first.longitude) + 1;
+      cells.push_back({span.first.latitude, span.first.longitude + int64_t(rng() % width)});
+    }
+
+    std::string size = "vertices=" + std::to_string(vertices);
+    auto res = bench::measure(1, 5, [&](size_t){ return 0; }, [&](int&){ bench::do_not_optimize(ray_cast_inside(polygon, cells)); });
+    bench::print_row(name + "_ray_cast", params(batch, size), res);
+    res = bench::measure(1, 5, [&](size_t){ return 0; }, [&](int&){ bench::do_not_optimize(cells_inside(polygon, cells)); });
+    bench::print_row(name + "_sweep", params(batch, size), res);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+
+  bench::print_header();
+  bench_merge_sets(filter);
+  bench_insert_interval(filter);
+  bench_substract_amount(filter);
+  bench_substract_scaling(filter);
+  bench_remove_id(filter);
+  bench_small_transfer(filter);
+  bench_membership(filter);
+  bench_packed(filter);
+  bench_box_query(filter);
+  bench_point_in_polygon(filter);
+  return 0;
+}
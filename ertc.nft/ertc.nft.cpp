@@ -10,6 +10,57 @@ void nft::open(name account, symbol sym) {
   add_balance(account, asset{0, sym}, {});
 }
 
+void nft::migrate(vector<name> owners) {
+  require_auth( _self );
+
+  for (auto owner: owners) {
+    account_index acnts( _self, owner.value );
+    for (auto it = acnts.begin(); it != acnts.end(); ++it) {
+      if (!it->tokens.has_value()) continue;
+      move_legacy_ids( owner, *it );
+      acnts.modify( it, same_payer, [&]( auto& a ) {
+        clear_legacy_ids(a);
+      });
+    }
+  }
+}
+
+void nft::migratetoken( uint32_t limit ) {
+   require_auth( _self );
+
+   // the old table is all the backfills go through, and the rows would
+   // also drop out of the bycoords probe of issue
+   auto st = get_state();
+   check( st.untiled_from.value_or(0) == CURSOR_DONE && st.unindexed_from.value_or(0) == CURSOR_DONE,
+          "run filltiles and reindex first" );
+   check( tokens.begin() != tokens.end(), "all tokens are migrated already" );
+
+   if( !st.token_symbol.has_value() ) {
+      st.token_symbol.emplace( tokens.begin()->value.symbol );
+      state_singleton( _self, _self.value ).set( st, _self );
+   }
+   asset unit{1, st.token_symbol.value()};
+
+   // rows come in id order, the ids of a validation mostly in one piece
+   std::map<uint64_t, interval_set> issued;
+   for (auto it = tokens.begin(); it != tokens.end() && limit > 0; --limit) {
+      check( it->value == unit, "token value is not one unit of the contract symbol" );
+      tokens_v2.emplace( _self, [&]( auto& token ) {
+         token.id = it->id;
+         token.coords = it->coords;
+         token.validation = it->validation;
+      });
+      auto& ids = issued[it->validation];
+      if( !ids.empty() && ids.back().second + 1 == it->id )
+         ids.back().second = it->id;
+      else
+         ids.push_back({it->id, it->id});
+      it = tokens.erase( it );
+   }
+   for (const auto& [validation, ids]: issued)
+      add_validation_ids( validation, ids );
+}
+
 void nft::create( name issuer, std::string sym ) {
   require_auth( _self );
 
@@ -36,49 +87,245 @@ void nft::create( name issuer, std::string sym ) {
 }
 
 void nft::issue( name to, asset quantity, vector<point> coords, uint64_t validation, string memo) {
+   INSTRUMENT_ACTION("nft::issue");
    check( is_account( to ), "to account does not exist");
-
-   // e.g. Get EOS from 3 EOS
-   auto symbol = quantity.symbol;
-   check( symbol.is_valid(), "invalid symbol name" );
-   check( symbol.precision() == 0, "quantity must be a integer" );
-   check( memo.size() <= 256, "memo has more than 256 bytes" );
-
-   // Ensure currency has been created
-   auto symbol_name = symbol.code().raw();
-   currency_index currency_table( _self, symbol_name );
-   auto existing_currency = currency_table.find( symbol_name );
-   check( existing_currency != currency_table.end(), "token with symbol does not exist. create token before issue" );
-   const auto& st = *existing_currency;
-
-   // Ensure have issuer authorization and valid quantity
-   require_auth( st.issuer );
-   check( quantity.is_valid(), "invalid quantity" );
-   check( quantity.amount > 0, "must issue positive quantity of NFT" );
-   check( symbol == st.supply.symbol, "symbol precision mismatch" );
-
-   // Increase supply
-   add_supply( quantity );
+   prepare_issue( quantity, memo );
 
    // Check that number of tokens matches coords size
    size_t coords_size = coords.size();
    check( quantity.amount == coords_size, "mismatch between number of tokens and coords provided" );
 
    id_pair ids;
-   ids.first = tokens.available_primary_key();
+   ids.first = reserve_ids( coords_size );
+   ids.second = ids.first + coords_size - 1;
+   vector<points_pair> runs;
+   runs.reserve(coords_size);
+   for (const auto& pt: coords)
+     runs.push_back({pt, pt});
+   occupy( runs );
    // Mint nfts
+   id_type id = ids.first;
    for (const auto& pt: coords)
-     mint( to, asset{1, symbol}, pt, validation);
-   ids.second = tokens.available_primary_key() - 1;
+     mint( id++, pt, validation);
    // Add balance to account
    add_balance( to, quantity, {ids} );
+   log_issue( to, validation, ids );
+}
+
+void nft::issuepacked( name to, asset quantity, packed_points coords, uint64_t validation, string memo) {
+   INSTRUMENT_ACTION("nft::issuepacked");
+   check( is_account( to ), "to account does not exist");
+   prepare_issue( quantity, memo );
+
+   // only the runs are kept, cells are decoded from them as they are minted
+   vector<points_pair> runs(coords.begin(), coords.end());
+   uint64_t cells = 0;
+   for (const auto& run: runs) {
+     check( run.first.longitude <= run.second.longitude, "invalid cell run" );
+     cells += uint64_t(run.second.longitude) - uint64_t(run.first.longitude) + 1;
+     check( cells <= uint64_t(quantity.amount), "mismatch between number of tokens and coords provided" );
+   }
+   check( uint64_t(quantity.amount) == cells, "mismatch between number of tokens and coords provided" );
+
+   id_pair ids;
+   ids.first = reserve_ids( cells );
+   ids.second = ids.first + cells - 1;
+   occupy( runs );
+   id_type id = ids.first;
+   for (const auto& run: runs)
+     for (point pt = run.first; pt.longitude <= run.second.longitude; ++pt.longitude)
+       mint( id++, pt, validation);
+   add_balance( to, quantity, {ids} );
+   log_issue( to, validation, ids );
+}
+
+void nft::issuerect( name to, asset quantity, vector<points_pair> areas, uint64_t validation, string memo) {
+   INSTRUMENT_ACTION("nft::issuerect");
+   check( is_account( to ), "to account does not exist");
+   prepare_issue( quantity, memo );
+
+   uint64_t cells = 0;
+   uint64_t height = 0;
+   for (auto& area: areas) {
+     area = normalize_range(area);
+     uint64_t lat_side = uint64_t(area.second.latitude) - uint64_t(area.first.latitude);
+     uint64_t long_side = uint64_t(area.second.longitude) - uint64_t(area.first.longitude);
+     check( lat_side < MAX_BLOCK_SIDE && long_side < MAX_BLOCK_SIDE, "area is too large" );
+     cells += points_range_length(area);
+     height = std::max(height, lat_side);
+   }
+   check( uint64_t(quantity.amount) == cells, "mismatch between number of tokens and cells provided" );
+
+   // the areas are checked one by one against the tokens and the blocks
+   // issued so far, including the ones before them in this action
+   id_pair ids;
+   ids.first = reserve_ids( cells, height );
+   ids.second = ids.first + cells - 1;
+   auto max_height = max_block_height();
+   bool probe = get_state().untiled_from.value_or(0) != CURSOR_DONE;
+   id_type id = ids.first;
+   for (const auto& area: areas) {
+     check_free( area, max_height, probe );
+     uint64_t length = points_range_length(area);
+     blocks.emplace( _self, [&]( auto& b ) {
+        b.first_id = id;
+        b.last_id = id + length - 1;
+        b.area = area;
+        b.offset = 0;
+        b.value = asset{1, quantity.symbol};
+        b.validation = validation;
+     });
+     id += length;
+   }
+   add_balance( to, quantity, {ids} );
+   log_issue( to, validation, ids );
+}
+
+void nft::issuelog( name to, uint64_t, interval_set ) {
+   require_auth( _self );
+   require_recipient( to );
+}
+
+interval_set nft::tokensbyval( uint64_t validation ) {
+   auto it = validations.find( validation );
+   return it == validations.end() ? interval_set{} : it->ids;
+}
+
+// Records the ids against the validation and tells the recipient.
+void nft::log_issue( name to, uint64_t validation, const id_pair& ids ) {
+   add_validation_ids( validation, {ids} );
+   action( permission_level{ _self, "active"_n }, _self, "issuelog"_n,
+           std::make_tuple(to, validation, interval_set{ids}) ).send();
+}
+
+void nft::add_validation_ids( uint64_t validation, const interval_set& ids ) {
+   auto it = validations.find( validation );
+   if( it == validations.end() ) {
+      validations.emplace( _self, [&]( auto& v ) {
+         v.validation = validation;
+         v.ids = ids;
+      });
+   } else {
+      validations.modify( it, same_payer, [&]( auto& v ) {
+         INSTRUMENT_COUNT(sets_in, v.ids.size());
+         merge_sets( v.ids, ids.begin(), ids.end() );
+         INSTRUMENT_COUNT(sets_out, v.ids.size());
+      });
+   }
+}
+
+void nft::filltiles( uint32_t limit ) {
+   require_auth( _self );
+
+   auto st = get_state();
+   id_type from = st.untiled_from.value_or(0);
+   check( from != CURSOR_DONE, "all tokens are in tiles already" );
+
+   // rows are written once per tile at the end
+   std::map<uint64_t, vector<uint64_t>> touched;
+   tile_index tiles( _self, _self.value );
+   auto it = tokens.lower_bound( from );
+   for (; it != tokens.end() && limit > 0; ++it, --limit) {
+      // such coordinates cannot be minted anymore, nothing to protect
+      if( !tile::in_range(it->coords) ) continue;
+
+      auto key = tile::key_of(it->coords);
+      auto cached = touched.find(key);
+      if( cached == touched.end() ) {
+         auto row = tiles.find(key);
+         cached = touched.emplace(key, row != tiles.end() ? row->cells : vector<uint64_t>(TILE_SIDE, 0)).first;
+      }
+      cached->second[tile::row(it->coords)] |= 1ull << tile::column(it->coords);
+   }
+   for (const auto& t: touched)
+      store_tile( tiles, t.first, t.second );
+
+   st.untiled_from.emplace( it == tokens.end() ? CURSOR_DONE : it->id );
+   state_singleton( _self, _self.value ).set( st, _self );
+}
+
+void nft::reindex( uint32_t limit ) {
+   require_auth( _self );
+
+   auto st = get_state();
+   id_type from = st.unindexed_from.value_or(0);
+   check( from != CURSOR_DONE, "all tokens are indexed already" );
+
+   auto it = tokens.lower_bound( from );
+   for (; it != tokens.end() && limit > 0; ++it, --limit) {
+      if( zorder.find(it->id) != zorder.end() ) continue;
+      zorder.emplace( _self, [&]( auto& z ) {
+         z.id = it->id;
+         z.zkey = morton_key(it->coords);
+      });
+   }
+
+   fill_cursors( st );
+   st.unindexed_from.emplace( it == tokens.end() ? CURSOR_DONE : it->id );
+   state_singleton( _self, _self.value ).set( st, _self );
+}
+
+vector<id_type> nft::tokensinbox( points_pair box, uint32_t limit ) {
+   check( limit > 0, "limit must be positive" );
+   check( get_state().unindexed_from.value_or(0) == CURSOR_DONE, "zorder index is incomplete, run reindex" );
+   box = normalize_range(box);
+
+   vector<id_type> result;
+   auto by_zkey = zorder.get_index<"byzkey"_n>();
+   for (const auto& range: morton_ranges(box)) {
+      // the ranges may reach a little outside of the box
+      for (auto it = by_zkey.lower_bound(range.first); it != by_zkey.end() && it->zkey <= range.second; ++it) {
+         auto pt = morton_point(it->zkey);
+         if( !ranges_overlap(box, {pt, pt}) ) continue;
+         result.push_back(it->id);
+         if( result.size() == limit ) return result;
+      }
+   }
+
+   // block cells in the box, row by row, limited to the ones of each piece
+   for (const auto& b: overlapping_blocks(box, max_block_height())) {
+      uint64_t width = uint64_t(b.area.second.longitude) - uint64_t(b.area.first.longitude) + 1;
+      uint64_t last = b.offset + (b.last_id - b.first_id);
+      uint64_t lat_from = uint64_t(std::max(b.area.first.latitude, box.first.latitude)) - uint64_t(b.area.first.latitude);
+      uint64_t lat_to = uint64_t(std::min(b.area.second.latitude, box.second.latitude)) - uint64_t(b.area.first.latitude);
+      uint64_t lon_from = uint64_t(std::max(b.area.first.longitude, box.first.longitude)) - uint64_t(b.area.first.longitude);
+      uint64_t lon_to = uint64_t(std::min(b.area.second.longitude, box.second.longitude)) - uint64_t(b.area.first.longitude);
+
+      for (uint64_t row = std::max(lat_from, b.offset / width); row <= lat_to && row * width <= last; ++row) {
+         uint64_t from = std::max(row * width + lon_from, b.offset);
+         uint64_t to = std::min(row * width + lon_to, last);
+         for (uint64_t cell = from; cell <= to; ++cell) {
+            result.push_back(b.first_id + (cell - b.offset));
+            if( result.size() == limit ) return result;
+         }
+      }
+   }
+   return result;
+}
+
+name nft::ownerof( id_type id ) {
+   return owner_of( id );
+}
+
+void nft::indexowners( vector<name> accounts ) {
+   require_auth( _self );
+
+   for (auto owner: accounts) {
+      account_index acnts( _self, owner.value );
+      for (const auto& a: acnts)
+         check( !a.tokens.has_value(), "account holds ids in its row, migrate it first" );
+
+      page_index pages( _self, owner.value );
+      for (const auto& pg: pages)
+         set_owner( owner, decode_intervals(pg.tokens) );
+   }
 }
 
 void nft::transferid( name	from,
                       name 	to,
                       id_type	id,
                       string	memo ) {
-   check(false, "transferid action is disabled");
+   INSTRUMENT_ACTION("nft::transferid");
    // Ensure authorized to send from account
    check( from != to, "cannot transfer to self" );
    require_auth( from );
@@ -89,24 +336,103 @@ void nft::transferid( name	from,
   // Check memo size and print
    check( memo.size() <= 256, "memo has more than 256 bytes" );
 
-   // Ensure token ID exists
-   auto send_token = tokens.find( id );
-   check( send_token != tokens.end(), "token with specified ID does not exist" );
-   const auto& st = *send_token;
+   // Ensure token ID is owned before a block gets split for it. Ids held
+   // since before the owners table have no owner there yet, for those the
+   // sender's pages decide in sub_balance, after its row is migrated
+   auto owner = owner_of( id );
+   check( owner == from || owner == name(), "does not own specified token id" );
+   const auto& st = find_token( id );
 
    // Notify both recipients
    require_recipient( from );
    require_recipient( to );
 
    // Change balance of both accounts
-   sub_id( from, st.value, id );
+   sub_balance( from, st.value, {{id,id}} );
    add_balance( to, st.value, {{id,id}} );
 }
 
+void nft::transferids( name         from,
+                       name         to,
+                       asset        quantity,
+                       interval_set ids,
+                       string       memo ) {
+   INSTRUMENT_ACTION("nft::transferids");
+   // Ensure authorized to send from account
+   check( from != to, "cannot transfer to self" );
+   require_auth( from );
+
+   // Ensure 'to' account exists
+   check( is_account( to ), "to account does not exist");
+
+   // Check memo size and print
+   check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+   check( quantity.is_valid() && quantity.amount > 0, "must transfer positive quantity" );
+   check_ids( ids, quantity.amount );
+
+   // Notify both recipients
+   require_recipient( from );
+   require_recipient( to );
+
+   sub_balance( from, quantity, ids );
+   add_balance( to, quantity, ids );
+}
+
+void nft::transferbatch( name                           from,
+                         vector<std::pair<name, asset>> transfers,
+                         interval_set                   ids,
+                         string                         memo ) {
+   INSTRUMENT_ACTION("nft::transferbatch");
+   require_auth( from );
+   check( memo.size() <= 256, "memo has more than 256 bytes" );
+   check( !transfers.empty(), "no transfers given" );
+
+   asset total{0, transfers.front().second.symbol};
+   for (const auto& [to, quantity]: transfers) {
+      check( from != to, "cannot transfer to self" );
+      check( is_account( to ), "to account does not exist");
+      check( quantity.is_valid() && quantity.amount > 0, "must transfer positive quantity" );
+      check( quantity.symbol == total.symbol, "symbol precision mismatch" );
+      total += quantity;
+   }
+
+   // the sender's pages are gone through once for all recipients
+   if( ids.empty() ) {
+      ids = sub_balance( from, total );
+   } else {
+      check_ids( ids, total.amount );
+      sub_balance( from, total, ids );
+   }
+
+   require_recipient( from );
+   // slices are cut from the back, so the first recipient gets the lowest ids
+   for (auto it = transfers.rbegin(); it != transfers.rend(); ++it) {
+      require_recipient( it->first );
+      add_balance( it->first, it->second, substract_amount(ids, it->second.amount) );
+   }
+}
+
+void nft::retire( name owner, asset quantity, interval_set ids, string memo ) {
+   INSTRUMENT_ACTION("nft::retire");
+   require_auth( owner );
+   check( memo.size() <= 256, "memo has more than 256 bytes" );
+   check( quantity.is_valid() && quantity.amount > 0, "must retire positive quantity" );
+   check_ids( ids, quantity.amount );
+
+   require_recipient( owner );
+
+   sub_balance( owner, quantity, ids );
+   sub_supply( quantity );
+   set_owner( name(), ids );
+   burn_ids( ids );
+}
+
 void nft::transfer( name 	from,
                     name 	to,
                     asset	quantity,
                     string	memo ) {
+   INSTRUMENT_ACTION("nft::transfer");
    // Ensure authorized to send from account
    check( from != to, "cannot transfer to self" );
    require_auth( from );
@@ -125,42 +451,454 @@ void nft::transfer( name 	from,
   add_balance( to, quantity, token_ids );
 }
 
-id_type nft::mint( name 	 owner,
-                asset 	 value,
-                point 	 coords,
-            uint64_t validation) {
-   // Check coords uniqueness
-   auto coords_index = tokens.get_index<"bycoords"_n>();
-   eosio::check(coords_index.find(token::to_coords_id(coords)) == coords_index.end(), "token coordinates are not unique");
+// Checks, supply and issuer auth shared by issue and issuerect.
+void nft::prepare_issue( asset quantity, const string& memo ) {
+   // e.g. Get EOS from 3 EOS
+   auto symbol = quantity.symbol;
+   check( symbol.is_valid(), "invalid symbol name" );
+   check( symbol.precision() == 0, "quantity must be a integer" );
+   check( memo.size() <= 256, "memo has more than 256 bytes" );
 
-   auto it = tokens.emplace( _self, [&]( auto& token ) {
-      token.id = tokens.available_primary_key();
+   // Ensure currency has been created
+   auto symbol_name = symbol.code().raw();
+   currency_index currency_table( _self, symbol_name );
+   auto existing_currency = currency_table.find( symbol_name );
+   check( existing_currency != currency_table.end(), "token with symbol does not exist. create token before issue" );
+   const auto& st = *existing_currency;
+
+   // Ensure have issuer authorization and valid quantity
+   require_auth( st.issuer );
+   check( quantity.is_valid(), "invalid quantity" );
+   check( quantity.amount > 0, "must issue positive quantity of NFT" );
+   check( symbol == st.supply.symbol, "symbol precision mismatch" );
+
+   // token rows do not store their value, it is one unit of this symbol
+   state_singleton state_table( _self, _self.value );
+   auto current = get_state();
+   if( !current.token_symbol.has_value() ) {
+      fill_cursors( current );
+      current.token_symbol.emplace( symbol );
+      state_table.set( current, _self );
+   }
+   check( current.token_symbol.value() == symbol, "contract issues a single token symbol" );
+
+   // Increase supply
+   add_supply( quantity );
+}
+
+// Token ids are handed out by this counter rather than derived from the
+// token table, block tokens have no row of their own until they are split.
+nft::state nft::get_state() {
+   state_singleton state_table( _self, _self.value );
+   if( state_table.exists() )
+      return state_table.get();
+
+   state st;
+   st.next_id = tokens.available_primary_key();
+   st.max_block_height = 0;
+   if( tokens.begin() == tokens.end() ) {
+      st.untiled_from.emplace( CURSOR_DONE );
+      st.unindexed_from.emplace( CURSOR_DONE );
+   }
+   return st;
+}
+
+id_type nft::reserve_ids( uint64_t count, uint64_t block_height ) {
+   auto st = get_state();
+   id_type first = st.next_id;
+   st.next_id += count;
+   st.max_block_height = std::max(st.max_block_height, block_height);
+   state_singleton( _self, _self.value ).set( st, _self );
+   return first;
+}
+
+uint64_t nft::max_block_height() {
+   state_singleton state_table( _self, _self.value );
+   return state_table.exists() ? state_table.get().max_block_height : 0;
+}
+
+// An extension can only be written when the ones before it are, cursors
+// that were never set start from the first token.
+void nft::fill_cursors( state& st ) {
+   if( !st.untiled_from.has_value() )
+      st.untiled_from.emplace( 0 );
+   if( !st.unindexed_from.has_value() )
+      st.unindexed_from.emplace( 0 );
+}
+
+void nft::mint( id_type  id,
+                point    coords,
+                uint64_t validation) {
+   INSTRUMENT_COUNT(cells_minted, 1);
+   tokens_v2.emplace( _self, [&]( auto& token ) {
+      token.id = id;
       token.coords = coords;
-      token.value = value;
       token.validation = validation;
    });
+   zorder.emplace( _self, [&]( auto& z ) {
+      z.id = id;
+      z.zkey = morton_key(coords);
+   });
+}
+
+// Marks the cells of the one-row `runs` as taken, with one tile row read
+// and written per tile. Fails if any of them is taken by a token or a block
+// already.
+void nft::occupy( const vector<points_pair>& runs ) {
+   // runs are cut at tile borders, so every piece lies in a single tile row
+   vector<std::pair<uint64_t, points_pair>> pieces;
+   pieces.reserve(runs.size());
+   for (const auto& run: runs) {
+      check( run.first.latitude == run.second.latitude && run.first.longitude <= run.second.longitude, "invalid cell run" );
+      INSTRUMENT_COUNT(cells_occupied, run.second.longitude - run.first.longitude + 1);
+      point from = run.first;
+      for (;;) {
+         int64_t tile_end = from.longitude | int64_t(TILE_SIDE - 1);
+         point to{from.latitude, std::min(tile_end, run.second.longitude)};
+         pieces.push_back({tile::key_of(from), {from, to}});
+         if( to.longitude == run.second.longitude ) break;
+         from.longitude = to.longitude + 1;
+      }
+   }
+   std::sort(pieces.begin(), pieces.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+
+   // tokens minted before tiles may be missing from the bitmaps
+   bool probe = get_state().untiled_from.value_or(0) != CURSOR_DONE;
+   auto max_height = max_block_height();
+   tile_index tiles( _self, _self.value );
+
+   for (auto group = pieces.begin(); group != pieces.end(); ) {
+      auto group_end = std::find_if(group, pieces.end(), [&](const auto& k){ return k.first != group->first; });
+
+      points_pair bounds = group->second;
+      for (auto it = group; it != group_end; ++it) {
+         const auto& piece = it->second;
+         bounds.first = {std::min(bounds.first.latitude, piece.first.latitude), std::min(bounds.first.longitude, piece.first.longitude)};
+         bounds.second = {std::max(bounds.second.latitude, piece.second.latitude), std::max(bounds.second.longitude, piece.second.longitude)};
+      }
+      auto hits = overlapping_blocks(bounds, max_height);
+
+      auto row = tiles.find(group->first);
+      auto cells = row != tiles.end() ? row->cells : vector<uint64_t>(TILE_SIDE, 0);
+      for (auto it = group; it != group_end; ++it) {
+         const auto& piece = it->second;
+         for (const auto& b: hits)
+            check( !ranges_overlap(b.area, piece), "area overlaps an issued block" );
+         if( probe )
+            probe_coords( piece );
+
+         auto& line = cells[tile::row(piece.first)];
+         uint64_t bits = tile::columns(piece);
+         check( !(line & bits), "token coordinates are not unique" );
+         line |= bits;
+      }
+      store_tile( tiles, group->first, cells );
+      group = group_end;
+   }
+}
+
+void nft::store_tile( tile_index& tiles, uint64_t key, const vector<uint64_t>& cells ) {
+   auto row = tiles.find(key);
+   if( row == tiles.end() ) {
+      tiles.emplace( _self, [&]( auto& t ) {
+         t.key = key;
+         t.cells = cells;
+      });
+   } else {
+      tiles.modify( row, same_payer, [&]( auto& t ) {
+         t.cells = cells;
+      });
+   }
+}
+
+// Blocks are indexed by their low latitude, so the ones that can reach
+// into `area` start at most `max_height` below it.
+vector<nft::block> nft::overlapping_blocks( const points_pair& area, uint64_t max_height ) {
+   vector<block> result;
+   auto by_latitude = blocks.get_index<"bylatitude"_n>();
+   uint64_t low = block::sortable(area.first.latitude);
+   low = low > max_height ? low - max_height : 0;
+   for (auto it = by_latitude.lower_bound(low); it != by_latitude.end() && it->area.first.latitude <= area.second.latitude; ++it)
+      if( ranges_overlap(it->area, area) )
+         result.push_back(*it);
+   return result;
+}
+
+// The checks of occupy for a whole area: fails if any cell of `area` is
+// taken by a block, by a token in the tile bitmaps or, with `probe`, by a
+// token the bitmaps may be missing.
+void nft::check_free( const points_pair& area, uint64_t max_height, bool probe ) {
+   check( overlapping_blocks(area, max_height).empty(), "area overlaps an issued block" );
+   for (const auto& part: split_signs(area)) {
+      check_tiles( part );
+      if( probe )
+         probe_coords( part );
+   }
+}
+
+// Fails if a tile bit is set in `area`. Only the tile rows that exist are
+// read, a row of tiles without any is passed in one lower_bound.
+void nft::check_tiles( const points_pair& area ) {
+   tile_index tiles( _self, _self.value );
+   uint64_t first = tile::key_of(area.first), last = tile::key_of(area.second);
+   uint32_t first_column = uint32_t(first), last_column = uint32_t(last);
+   for (auto it = tiles.lower_bound(first); it != tiles.end() && it->key <= last; ) {
+      uint32_t row = it->key >> 32, column = uint32_t(it->key);
+      if( column < first_column ) {
+         it = tiles.lower_bound( (uint64_t(row) << 32) | first_column );
+         continue;
+      }
+      if( column > last_column ) {
+         if( row == uint32_t(last >> 32) ) break;
+         it = tiles.lower_bound( (uint64_t(row + 1) << 32) | first_column );
+         continue;
+      }
+
+      point origin{int64_t(int32_t(row)) * TILE_SIDE, int64_t(int32_t(column)) * TILE_SIDE};
+      point from{std::max(area.first.latitude, origin.latitude), std::max(area.first.longitude, origin.longitude)};
+      point to{std::min(area.second.latitude, origin.latitude + TILE_SIDE - 1), std::min(area.second.longitude, origin.longitude + TILE_SIDE - 1)};
+      uint64_t bits = tile::columns({from, to});
+      for (point pt = from; pt.latitude <= to.latitude; ++pt.latitude)
+         check( !(it->cells[tile::row(pt)] & bits), "token coordinates are not unique" );
+      ++it;
+   }
+}
+
+// Fails if the bycoords index holds a token in `area`, for tokens minted
+// before tiles. Latitudes without any are passed in one lower_bound.
+void nft::probe_coords( const points_pair& area ) {
+   auto coords_index = tokens.get_index<"bycoords"_n>();
+   // the index orders coordinates as unsigned, like the split areas do
+   uint64_t first_longitude = area.first.longitude, last_longitude = area.second.longitude;
+   auto last = token::to_coords_id(area.second);
+   for (auto it = coords_index.lower_bound(token::to_coords_id(area.first)); it != coords_index.end() && it->get_coords_id() <= last; ) {
+      point pt = it->coords;
+      if( uint64_t(pt.longitude) < first_longitude ) {
+         it = coords_index.lower_bound( token::to_coords_id({pt.latitude, area.first.longitude}) );
+         continue;
+      }
+      if( uint64_t(pt.longitude) > last_longitude ) {
+         if( pt.latitude == area.second.latitude ) break;
+         it = coords_index.lower_bound( token::to_coords_id({pt.latitude + 1, area.first.longitude}) );
+         continue;
+      }
+      check( false, "token coordinates are not unique" );
+   }
+}
+
+// `area` cut at latitude and longitude 0. The tile and bycoords keys order
+// the cells of every part row by row, they do not across the cut.
+vector<points_pair> nft::split_signs( const points_pair& area ) {
+   auto halves = [](int64_t first, int64_t last) {
+      vector<std::pair<int64_t, int64_t>> result;
+      if( first < 0 )
+         result.push_back( {first, std::min<int64_t>(last, -1)} );
+      if( last >= 0 )
+         result.push_back( {std::max<int64_t>(first, 0), last} );
+      return result;
+   };
+   vector<points_pair> parts;
+   for (const auto& latitudes: halves(area.first.latitude, area.second.latitude))
+      for (const auto& longitudes: halves(area.first.longitude, area.second.longitude))
+         parts.push_back( {{latitudes.first, longitudes.first}, {latitudes.second, longitudes.second}} );
+   return parts;
+}
+
+// Tokens of a block get a row of their own the first time they are used
+// by id, the rest of the block stays in one or two pieces around it. Rows
+// of both layouts are read.
+nft::token nft::find_token( id_type id ) {
+   auto row = tokens_v2.find( id );
+   if( row != tokens_v2.end() )
+      return token{row->id, row->coords, asset{1, get_state().token_symbol.value()}, row->validation};
+   auto it = tokens.find( id );
+   if( it != tokens.end() )
+      return *it;
+
+   auto next = blocks.upper_bound( id );
+   check( next != blocks.begin(), "token with specified ID does not exist" );
+   auto piece = std::prev(next);
+   check( id <= piece->last_id, "token with specified ID does not exist" );
+   const auto b = *piece;
+
+   if( id < b.last_id ) {
+      blocks.emplace( _self, [&]( auto& rest ) {
+         rest = b;
+         rest.first_id = id + 1;
+         rest.offset = b.offset + (id + 1 - b.first_id);
+      });
+   }
+   if( id > b.first_id ) {
+      blocks.modify( piece, same_payer, [&]( auto& head ) {
+         head.last_id = id - 1;
+      });
+   } else {
+      blocks.erase( piece );
+   }
+
+   // the cell is in no block any more, its tile bit keeps it taken after
+   // the pieces around it are burned
+   auto coords = range_point(b.area, b.offset + (id - b.first_id));
+   tile_index tiles( _self, _self.value );
+   uint64_t key = tile::key_of(coords);
+   auto in_tiles = tiles.find( key );
+   auto cells = in_tiles != tiles.end() ? in_tiles->cells : vector<uint64_t>(TILE_SIDE, 0);
+   cells[tile::row(coords)] |= 1ull << tile::column(coords);
+   store_tile( tiles, key, cells );
+
+   mint( id, coords, b.validation );
+   return token{id, coords, b.value, b.validation};
+}
+
+// Erases what records the tokens `ids`: rows of either layout with their
+// index entries, zorder entries, tile bits and block pieces, and takes them
+// out of their validation.
+void nft::burn_ids( const interval_set& ids ) {
+   vector<std::pair<uint64_t, id_pair>> burned;   // validation and ids
+   vector<point> cells;
+
+   for (const auto& range: ids) {
+      uint64_t found = 0;
+      for (auto it = tokens_v2.lower_bound( range.first ); it != tokens_v2.end() && it->id <= range.second; ++found) {
+         cells.push_back( it->coords );
+         burned.push_back( {it->validation, {it->id, it->id}} );
+         it = tokens_v2.erase( it );
+      }
+      for (auto it = tokens.lower_bound( range.first ); it != tokens.end() && it->id <= range.second; ++found) {
+         cells.push_back( it->coords );
+         burned.push_back( {it->validation, {it->id, it->id}} );
+         it = tokens.erase( it );
+      }
+      for (auto it = zorder.lower_bound( range.first ); it != zorder.end() && it->id <= range.second; )
+         it = zorder.erase( it );
+
+      // block pieces keep their area, the part of a piece outside the
+      // range stays as a piece of its own
+      auto piece = blocks.upper_bound( range.first );
+      if( piece != blocks.begin() && std::prev(piece)->last_id >= range.first )
+         --piece;
+      while( piece != blocks.end() && piece->first_id <= range.second ) {
+         const auto b = *piece;
+         id_type first = std::max(b.first_id, range.first), last = std::min(b.last_id, range.second);
+         burned.push_back( {b.validation, {first, last}} );
+         found += last - first + 1;
+
+         if( last < b.last_id ) {
+            blocks.emplace( _self, [&]( auto& rest ) {
+               rest = b;
+               rest.first_id = last + 1;
+               rest.offset = b.offset + (last + 1 - b.first_id);
+            });
+         }
+         if( first > b.first_id ) {
+            blocks.modify( piece, same_payer, [&]( auto& head ) {
+               head.last_id = first - 1;
+            });
+            ++piece;
+         } else {
+            piece = blocks.erase( piece );
+         }
+      }
+      check( found == range.second - range.first + 1, "token with specified ID does not exist" );
+   }
+
+   clear_tiles( std::move(cells) );
+
+   std::sort(burned.begin(), burned.end(), [](const auto& a, const auto& b){
+      return a.first < b.first || (a.first == b.first && a.second.first < b.second.first);
+   });
+   for (auto it = burned.begin(); it != burned.end(); ) {
+      interval_set of_validation;
+      auto validation = it->first;
+      for (; it != burned.end() && it->first == validation; ++it) {
+         if( !of_validation.empty() && of_validation.back().second + 1 == it->second.first )
+            of_validation.back().second = it->second.second;
+         else
+            of_validation.push_back( it->second );
+      }
+      remove_validation_ids( validation, of_validation );
+   }
+}
+
+// Clears the tile bits of `cells`. Old tokens not filled in yet have none,
+// clearing them changes nothing.
+void nft::clear_tiles( vector<point> cells ) {
+   std::sort(cells.begin(), cells.end(), [](const point& a, const point& b){
+      return tile::key_of(a) < tile::key_of(b);
+   });
+   tile_index tiles( _self, _self.value );
+   for (auto group = cells.begin(); group != cells.end(); ) {
+      uint64_t key = tile::key_of(*group);
+      auto group_end = std::find_if(group, cells.end(), [&](const point& pt){ return tile::key_of(pt) != key; });
 
-   return it->id;
+      auto row = tiles.find( key );
+      if( row != tiles.end() ) {
+         auto bits = row->cells;
+         for (auto it = group; it != group_end; ++it)
+            bits[tile::row(*it)] &= ~(1ull << tile::column(*it));
+         if( std::all_of(bits.begin(), bits.end(), [](uint64_t line){ return line == 0; }) )
+            tiles.erase( row );
+         else
+            store_tile( tiles, key, bits );
+      }
+      group = group_end;
+   }
 }
 
-void nft::sub_id( name owner, asset value, id_type id ) {
+// Ids of tokens issued before validations were recorded may be missing,
+// only the ones that are there are removed.
+void nft::remove_validation_ids( uint64_t validation, const interval_set& ids ) {
+   auto row = validations.find( validation );
+   if( row == validations.end() ) return;
+
+   interval_set present;
+   for (const auto& range: ids) {
+      auto it = std::lower_bound(row->ids.begin(), row->ids.end(), range.first, [](const auto& a, id_type id){
+         return a.second < id;
+      });
+      for (; it != row->ids.end() && it->first <= range.second; ++it)
+         present.push_back( {std::max(it->first, range.first), std::min(it->second, range.second)} );
+   }
+   if( present.empty() ) return;
+
+   auto rest = row->ids;
+   remove_sets( rest, present.cbegin(), present.cend() );
+   INSTRUMENT_COUNT(sets_in, row->ids.size());
+   INSTRUMENT_COUNT(sets_out, rest.size());
+   if( rest.empty() ) {
+      validations.erase( row );
+   } else {
+      validations.modify( row, same_payer, [&]( auto& v ) {
+         v.ids = std::move(rest);
+      });
+   }
+}
+
+// `ids` sorted, disjoint and holding exactly `amount` ids.
+void nft::check_ids( const interval_set& ids, int64_t amount ) {
+   int64_t count = 0;
+   for (auto it = ids.begin(); it != ids.end(); ++it) {
+      check( it->first <= it->second, "invalid token id interval" );
+      check( it == ids.begin() || std::prev(it)->second < it->first, "token ids must be sorted and disjoint" );
+      count += it->second - it->first + 1;
+      check( count <= amount, "mismatch between quantity and token ids" );
+   }
+   check( count == amount, "mismatch between quantity and token ids" );
+}
+
+void nft::sub_balance( name owner, asset value, const interval_set& ids ) {
    account_index from_acnts( _self, owner.value );
    const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
-   check( value.amount == 1, "can only substract one id");
    check( from.balance.amount >= value.amount, "overdrawn balance" );
-   //check( from.balance.amount == from.tokens.size(), "balance and tokens mismatch" );
-
-   auto it = std::lower_bound(from.tokens.begin(), from.tokens.end(), id, [](const auto& a, const auto& b){
-     return a.second < b;
-   });
-   check( it != from.tokens.end(), "does not own specified token id");
+   move_legacy_ids( owner, from );
 
+   remove_ids( owner, value.symbol.code(), ids );
    if( from.balance.amount == value.amount ) {
       from_acnts.erase( from );
    } else {
       from_acnts.modify( from, owner, [&]( auto& a ) {
           a.balance -= value;
-          a.tokens.erase(it);
+          clear_legacy_ids(a);
       });
    }
 }
@@ -170,16 +908,15 @@ interval_set nft::sub_balance( name owner, asset value ) {
    account_index from_acnts( _self, owner.value );
    const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
    check( from.balance.amount >= value.amount, "overdrawn balance" );
-   //check( from.balance.amount == from.tokens.size(), "balance and tokens mismatch" );
+   move_legacy_ids( owner, from );
 
-   interval_set result;
+   auto result = sub_ids( owner, value.symbol.code(), value.amount );
    if( from.balance.amount == value.amount ) {
-      result = from.tokens;
       from_acnts.erase( from );
    } else {
       from_acnts.modify( from, owner, [&]( auto& a ) {
           a.balance -= value;
-          result = substract_amount(a.tokens, value.amount);
+          clear_legacy_ids(a);
       });
    }
 
@@ -193,16 +930,260 @@ void nft::add_balance( name owner, asset value, const interval_set& ids ) {
    if( to == to_accounts.end() ) {
       to = to_accounts.emplace( _self, [&]( auto& a ){
          a.balance = value;
-         a.tokens = ids;
       });
    } else {
+      move_legacy_ids( owner, *to );
       to_accounts.modify( to, _self, [&]( auto& a ) {
          a.balance += value;
-         merge_sets(a.tokens, ids.begin(), ids.end());
+         clear_legacy_ids(a);
+      });
+   }
+   add_ids( owner, value.symbol.code(), ids );
+}
+
+void nft::add_ids( name owner, symbol_code sym, const interval_set& ids ) {
+   page_index pages( _self, owner.value );
+   auto by_start = pages.get_index<"bystart"_n>();
+
+   auto in = ids.begin();
+   while( in != ids.end() ) {
+      // the ids go into the page holding the ids right below them, or into
+      // the first page when there are none
+      auto next = by_start.upper_bound( page::page_key(sym, in->first) );
+      auto target = by_start.end();
+      if( next != by_start.begin() && std::prev(next)->sym == sym )
+         target = std::prev(next);
+      else if( next != by_start.end() && next->sym == sym )
+         target = next++;
+
+      // incoming ids are not owned yet, so none of them reaches into the
+      // following page and everything below its start lands in `target`
+      auto last = ids.end();
+      if( next != by_start.end() && next->sym == sym ) {
+         last = std::lower_bound(in, ids.end(), next->tokens.begin()->first, [](const auto& a, const auto& b){
+           return a.first < b;
+         });
+      }
+
+      if( target == by_start.end() ) {
+         store_pages( pages, sym, in, last );
+      } else {
+         by_start.modify( target, _self, [&]( auto& p ) {
+            INSTRUMENT_COUNT(sets_in, instrument::intervals(p.tokens));
+            merge_sets(p.tokens, in, last);
+            INSTRUMENT_COUNT(sets_out, instrument::intervals(p.tokens));
+         });
+         if( target->tokens.data.size() > PAGE_BYTES )
+            split_page( pages, *target );
+      }
+      in = last;
+   }
+   set_owner( owner, ids );
+}
+
+// Gives `ids` to `owner` in the owners table, cutting them out of the
+// ranges of their previous owners. An empty owner leaves them unowned.
+void nft::set_owner( name owner, const interval_set& ids ) {
+   for (const auto& in: ids) {
+      id_type first = in.first, last = in.second;
+
+      auto it = owner_ranges.lower_bound( first );
+      while( it != owner_ranges.end() && it->first_id <= last ) {
+         if( it->first_id < first ) {
+            owner_ranges.emplace( _self, [&]( auto& r ) {
+               r.first_id = it->first_id;
+               r.last_id = first - 1;
+               r.owner = it->owner;
+            });
+         }
+         if( it->last_id > last ) {
+            owner_ranges.modify( it, same_payer, [&]( auto& r ) {
+               r.first_id = last + 1;
+            });
+            break;
+         }
+         it = owner_ranges.erase( it );
+      }
+
+      if( owner == name() )
+         continue;
+
+      // join the ranges of the same owner right before and after
+      if( first > 0 ) {
+         auto left = owner_ranges.find( first - 1 );
+         if( left != owner_ranges.end() && left->owner == owner ) {
+            first = left->first_id;
+            owner_ranges.erase( left );
+         }
+      }
+      if( last < std::numeric_limits<id_type>::max() ) {
+         auto right = owner_ranges.lower_bound( last + 1 );
+         if( right != owner_ranges.end() && right->first_id == last + 1 && right->owner == owner ) {
+            owner_ranges.modify( right, same_payer, [&]( auto& r ) {
+               r.first_id = first;
+            });
+            continue;
+         }
+      }
+      owner_ranges.emplace( _self, [&]( auto& r ) {
+         r.first_id = first;
+         r.last_id = last;
+         r.owner = owner;
       });
    }
 }
 
+name nft::owner_of( id_type id ) {
+   auto it = owner_ranges.lower_bound( id );
+   if( it == owner_ranges.end() || it->first_id > id )
+      return name();
+   return it->owner;
+}
+
+// Takes `amount` ids from the back of the owner's pages, the same ids
+// substract_amount would take from a single set.
+interval_set nft::sub_ids( name owner, symbol_code sym, int64_t amount ) {
+   page_index pages( _self, owner.value );
+   auto by_start = pages.get_index<"bystart"_n>();
+
+   vector<interval_set> taken;
+   auto it = by_start.upper_bound( page::page_key(sym, std::numeric_limits<id_type>::max()) );
+   while( amount > 0 ) {
+      check( it != by_start.begin() && std::prev(it)->sym == sym, "balance and tokens mismatch" );
+      --it;
+      int64_t held = intervals_amount( it->tokens );
+      if( held <= amount ) {
+         taken.push_back( decode_intervals(it->tokens) );
+         amount -= held;
+         it = by_start.erase( it );
+      } else {
+         by_start.modify( it, _self, [&]( auto& p ) {
+            INSTRUMENT_COUNT(sets_in, instrument::intervals(p.tokens));
+            taken.push_back( substract_amount(p.tokens, amount) );
+            INSTRUMENT_COUNT(sets_out, instrument::intervals(p.tokens));
+         });
+         amount = 0;
+         join_page( pages, *it );
+      }
+   }
+
+   // neighbouring pages may hold adjacent ids
+   interval_set result;
+   for( auto chunk = taken.rbegin(); chunk != taken.rend(); ++chunk ) {
+      auto first = chunk->cbegin();
+      if( !result.empty() && result.back().second + 1 == first->first )
+         result.back().second = (first++)->second;
+      result.insert(result.end(), first, chunk->cend());
+   }
+   return result;
+}
+
+// Takes exactly `ids` out of the owner's pages, each page is rewritten once
+// for the part of `ids` it covers.
+void nft::remove_ids( name owner, symbol_code sym, const interval_set& ids ) {
+   page_index pages( _self, owner.value );
+   auto by_start = pages.get_index<"bystart"_n>();
+
+   interval_set rest = ids;
+   auto in = rest.begin();
+   while( in != rest.end() ) {
+      auto next = by_start.upper_bound( page::page_key(sym, in->first) );
+      check( next != by_start.begin() && std::prev(next)->sym == sym, "does not own specified token id" );
+      auto pg = std::prev(next);
+
+      // an interval running on into the following page is cut at its start
+      interval_set part;
+      if( next != by_start.end() && next->sym == sym ) {
+         id_type bound = next->tokens.begin()->first;
+         for (; in != rest.end() && in->first < bound; ++in) {
+            part.push_back({in->first, std::min(in->second, bound - 1)});
+            if( in->second >= bound ) {
+               in->first = bound;
+               break;
+            }
+         }
+      } else {
+         part.assign(in, rest.end());
+         in = rest.end();
+      }
+
+      auto held = decode_intervals( pg->tokens );
+      INSTRUMENT_COUNT(sets_in, held.size());
+      // transferid takes a single id, which needs no pass over the page
+      bool owned = part.size() == 1 && part[0].first == part[0].second
+                 ? remove_id(held, part[0].first)
+                 : remove_sets(held, part.cbegin(), part.cend());
+      check( owned, "does not own specified token id" );
+      INSTRUMENT_COUNT(sets_out, held.size());
+      if( held.empty() ) {
+         by_start.erase( pg );
+      } else {
+         by_start.modify( pg, _self, [&]( auto& p ) {
+            p.tokens = encode_intervals(held.begin(), held.end());
+         });
+         // ids taken from inside an interval leave two, the page can grow
+         if( pg->tokens.data.size() > PAGE_BYTES )
+            split_page( pages, *pg );
+         else
+            join_page( pages, *pg );
+      }
+   }
+}
+
+void nft::store_pages( page_index& pages, symbol_code sym, interval_set::const_iterator begin, interval_set::const_iterator end ) {
+   // new pages are left half empty so they take a few merges before splitting
+   for( auto it = begin; it != end; ) {
+      auto chunk = encode_chunk(it, end, PAGE_BYTES / 2);
+      pages.emplace( _self, [&]( auto& p ) {
+         p.id = pages.available_primary_key();
+         p.sym = sym;
+         p.tokens = std::move(chunk);
+      });
+   }
+}
+
+void nft::split_page( page_index& pages, const page& pg ) {
+   auto ids = decode_intervals( pg.tokens );
+   auto it = ids.cbegin();
+   auto head = encode_chunk(it, ids.cend(), PAGE_BYTES / 2);
+   pages.modify( pg, _self, [&]( auto& p ) {
+      p.tokens = std::move(head);
+   });
+   store_pages( pages, pg.sym, it, ids.cend() );
+}
+
+void nft::join_page( page_index& pages, const page& pg ) {
+   if( pg.tokens.data.size() >= PAGE_BYTES / 4 ) return;
+
+   auto by_start = pages.get_index<"bystart"_n>();
+   auto it = by_start.iterator_to( pg );
+   if( it == by_start.begin() ) return;
+   auto prev = std::prev(it);
+   if( prev->sym != pg.sym || prev->tokens.data.size() + pg.tokens.data.size() > PAGE_BYTES ) return;
+
+   auto ids = decode_intervals( pg.tokens );
+   by_start.modify( prev, _self, [&]( auto& p ) {
+      merge_sets(p.tokens, ids.cbegin(), ids.cend());
+   });
+   by_start.erase( it );
+}
+
+// Rows written before pages existed hold their ids themselves, they are
+// moved to pages the first time the row is touched.
+void nft::move_legacy_ids( name owner, const account& a ) {
+   if( a.packed_tokens.has_value() )
+      add_ids( owner, a.balance.symbol.code(), decode_intervals(a.packed_tokens.value()) );
+   else if( a.tokens.has_value() )
+      add_ids( owner, a.balance.symbol.code(), a.tokens.value() );
+}
+
+// Both go together, an extension can only be written when the ones before
+// it are.
+void nft::clear_legacy_ids( account& a ) {
+   a.tokens.reset();
+   a.packed_tokens.reset();
+}
+
 void nft::sub_supply( asset quantity ) {
 
    auto symbol_name = quantity.symbol.code().raw();
@@ -2,10 +2,17 @@
 
 #include <eosio/eosio.hpp>
 #include <eosio/asset.hpp>
+#include <eosio/binary_extension.hpp>
+#include <eosio/singleton.hpp>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <map>
 #include <prange.hpp>
+#include <packed_set.hpp>
+#include <morton.hpp>
+#include "instrument.hpp"
 
 namespace ertc {
 
@@ -18,7 +25,9 @@ class [[eosio::contract("ertc.nft")]] nft : public eosio::contract {
 public:
    using contract::contract;
    nft( name receiver, name code, datastream<const char*> ds)
-   : contract(receiver, code, ds), tokens(receiver, receiver.value) {}
+   : contract(receiver, code, ds), tokens(receiver, receiver.value), tokens_v2(receiver, receiver.value),
+     validations(receiver, receiver.value), owner_ranges(receiver, receiver.value),
+     blocks(receiver, receiver.value), zorder(receiver, receiver.value) {}
 
    [[eosio::action]]
    void create(name issuer, std::string symbol);
@@ -30,12 +39,98 @@ public:
                uint64_t validation,
                string memo);
 
+   // Same as issue with the cells in packed form, minted in the order
+   // they were packed.
+   [[eosio::action]]
+   void issuepacked( name to,
+                     asset quantity,
+                     packed_points coords,
+                     uint64_t validation,
+                     string memo);
+
+   // Issues one block token row per area instead of a row per cell. The
+   // areas get consecutive ids in order, cells row by row.
+   [[eosio::action]]
+   void issuerect( name to,
+                   asset quantity,
+                   vector<points_pair> areas,
+                   uint64_t validation,
+                   string memo);
+
+   // Puts the coordinates of up to `limit` tokens minted before tiles
+   // existed into the tile bitmaps. Until it has gone through all of them,
+   // issue keeps probing the bycoords index as well.
+   [[eosio::action]]
+   void filltiles(uint32_t limit);
+
+   // Adds up to `limit` tokens minted before the zorder table existed to
+   // it. tokensinbox refuses to answer until it has gone through all.
+   [[eosio::action]]
+   void reindex(uint32_t limit);
+
+   // Ids of up to `limit` tokens whose cell lies in `box`. Read only.
+   [[eosio::action]]
+   vector<id_type> tokensinbox(points_pair box, uint32_t limit);
+
+   // Tells `to` which ids an issue gave it, sent inline by the issue
+   // actions. It is authorized by ertc.nft@active, so on deployment the
+   // contract account needs eosio.code on its active permission
+   // (cleos set account permission ertc.nft active --add-code), or every
+   // issue fails.
+   [[eosio::action]]
+   void issuelog(name to, uint64_t validation, interval_set ids);
+
+   // Ids issued for `validation`, block tokens included. Tokens minted
+   // before this was recorded are only in it once migratetoken has moved
+   // them. Read only.
+   [[eosio::action]]
+   interval_set tokensbyval(uint64_t validation);
+
+   // Owner of token `id`, or an empty name when no one holds it or its
+   // owner has not been through indexowners yet. Read only.
+   [[eosio::action]]
+   name ownerof(id_type id);
+
+   // Records the owner of the ids `accounts` held in pages before the
+   // owners table existed. Accounts still holding ids in their rows need
+   // migrate first.
+   [[eosio::action]]
+   void indexowners(vector<name> accounts);
+
    [[eosio::action]]
    void transferid( name from,
                     name to,
                     id_type id,
                     string memo);
 
+   // Transfers exactly `ids`, which must be sorted and disjoint and hold
+   // quantity.amount ids.
+   [[eosio::action]]
+   void transferids( name from,
+                     name to,
+                     asset quantity,
+                     interval_set ids,
+                     string memo);
+
+   // Sends each recipient its quantity out of one removal from `from`,
+   // consecutive slices of `ids` in order, or of the ids transfer would
+   // take when `ids` is empty.
+   [[eosio::action]]
+   void transferbatch( name from,
+                       vector<std::pair<name, asset>> transfers,
+                       interval_set ids,
+                       string memo);
+
+   // Burns `ids` of `owner`, which must hold quantity.amount ids: they
+   // leave the balance and the supply, their rows go and their cells can
+   // be issued again. Cells of a block are only freed with its last piece.
+   // Every id costs a few row writes, callers keep batches small.
+   [[eosio::action]]
+   void retire( name owner,
+                asset quantity,
+                interval_set ids,
+                string memo);
+
    [[eosio::action]]
    void transfer( name from,
                   name to,
@@ -45,9 +140,22 @@ public:
    [[eosio::action]]
    void open(name account, symbol sym);
 
+   // Moves the token ids of `owners` out of their account rows into pages.
+   [[eosio::action]]
+   void migrate(vector<name> owners);
+
+   // Rewrites up to `limit` token rows to the v2 layout. Needs filltiles
+   // and reindex to be done, both only go through the old table.
+   [[eosio::action]]
+   void migratetoken(uint32_t limit);
+
+   // Same layout as the eosio.token accounts row, token ids live in pages.
+   // The extensions are only present in rows written before pages existed
+   // and are cleared once the row is touched.
    struct [[eosio::table]] account {
       asset balance;
-      interval_set tokens;
+      eosio::binary_extension<interval_set> tokens;
+      eosio::binary_extension<packed_interval_set> packed_tokens;
 
       uint64_t primary_key() const { return balance.symbol.code().raw(); }
    };
@@ -96,23 +204,202 @@ public:
       }
    };
 
-  using account_index = eosio::multi_index<"accounts"_n, account>;
+   // Token row of the v2 layout. Every token is worth one unit of the
+   // contract's symbol, so the asset is not stored; coordinates are looked
+   // up through the tiles and the zorder table and validations through
+   // validation_ids instead of an index.
+   struct [[eosio::table]] token_v2 {
+      id_type  id;
+      point    coords;
+      uint64_t validation;
+
+      id_type  primary_key() const { return id; }
+   };
+
+   // Ids issued for a validation. An issue hands out consecutive ids, so
+   // this is a few intervals per validation rather than an index entry per
+   // token.
+   struct [[eosio::table]] validation_ids {
+      uint64_t     validation;
+      interval_set ids;
+
+      uint64_t primary_key() const { return validation; }
+   };
+
+   // A slice of the ids an owner holds of one symbol. Pages of a symbol
+   // cover disjoint id ranges, ordered by their first id.
+   struct [[eosio::table]] page {
+      uint64_t            id;
+      symbol_code         sym;
+      packed_interval_set tokens;
+
+      uint64_t  primary_key() const { return id; }
+      uint128_t get_start()   const { return page_key(sym, tokens.begin()->first); }
+
+      static uint128_t page_key(symbol_code sym, id_type id) {
+        return (static_cast<uint128_t>(sym.raw()) << 64) | id;
+      }
+   };
+
+   // Owner of every id in first_id..last_id. Ranges are disjoint and keyed
+   // by their last id, so the range holding an id is the lower_bound of it.
+   // Ranges of one owner that meet are joined.
+   struct [[eosio::table]] owner_range {
+      id_type first_id;
+      id_type last_id;
+      name    owner;
+
+      id_type primary_key() const { return last_id; }
+   };
+
+   // Pages are split above PAGE_BYTES of encoded ids and joined with their
+   // neighbour once they fall under a quarter of it.
+   static constexpr size_t PAGE_BYTES = 512;
+
+   // Longest side of an issuerect area, keeps cell counts far from overflow.
+   static constexpr uint64_t MAX_BLOCK_SIDE = 1ull << 24;
+
+   // Tokens first_id..last_id of a block stand for the cells offset,
+   // offset + 1, ... of `area`. A block is split when one of its tokens is
+   // transferred by id, the pieces keep the whole area.
+   struct [[eosio::table]] block {
+      id_type     first_id;
+      id_type     last_id;
+      points_pair area;
+      uint64_t    offset;
+      asset       value;        // of each token
+      uint64_t    validation;
+
+      id_type  primary_key() const { return first_id; }
+      uint64_t get_latitude() const { return sortable(area.first.latitude); }
+
+      static uint64_t sortable(int64_t value) {
+        return static_cast<uint64_t>(value) ^ (1ull << 63);
+      }
+   };
+
+   struct [[eosio::table]] state {
+      id_type  next_id;
+      uint64_t max_block_height;   // latitude span of the tallest block
+      // first token ids filltiles and reindex have not been through
+      eosio::binary_extension<id_type> untiled_from;
+      eosio::binary_extension<id_type> unindexed_from;
+      eosio::binary_extension<symbol>  token_symbol;   // of every token, set by the first issue
+   };
+
+   // Z-order key of every token row. A table of its own rather than an
+   // index on token, which would have no entries for the existing rows.
+   struct [[eosio::table]] zpoint {
+      id_type   id;
+      uint128_t zkey;
+
+      id_type   primary_key() const { return id; }
+      uint128_t get_zkey()    const { return zkey; }
+   };
+
+   // Cells taken by single tokens, bit `column` of cells[row] for each
+   // cell of a TILE_SIDE x TILE_SIDE tile.
+   struct [[eosio::table]] tile {
+      uint64_t         key;
+      vector<uint64_t> cells;
+
+      uint64_t primary_key() const { return key; }
+
+      static bool in_range(const point& pt) {
+        int64_t lat = pt.latitude >> TILE_BITS, lon = pt.longitude >> TILE_BITS;
+        return lat == int32_t(lat) && lon == int32_t(lon);
+      }
+
+      static uint64_t key_of(const point& pt) {
+        check(in_range(pt), "coordinates out of range");
+        return (uint64_t(uint32_t(pt.latitude >> TILE_BITS)) << 32) | uint32_t(pt.longitude >> TILE_BITS);
+      }
+
+      static uint32_t row(const point& pt) { return pt.latitude & (TILE_SIDE - 1); }
+      static uint32_t column(const point& pt) { return pt.longitude & (TILE_SIDE - 1); }
+
+      // bits of the columns of `run`, which lies in one row of a tile
+      static uint64_t columns(const points_pair& run) {
+        uint32_t first = column(run.first), last = column(run.second);
+        return (~0ull >> (TILE_SIDE - 1 - (last - first))) << first;
+      }
+   };
+
+   static constexpr uint32_t TILE_BITS = 6;
+   static constexpr uint32_t TILE_SIDE = 1u << TILE_BITS;
+   // cursor value of a finished backfill
+   static constexpr id_type  CURSOR_DONE = std::numeric_limits<id_type>::max();
+
+  using account_index = instrument::table< eosio::multi_index<"accounts"_n, account> >;
+
+  using block_index = instrument::table< eosio::multi_index<"blocks"_n, block,
+                                         indexed_by< "bylatitude"_n, const_mem_fun< block, uint64_t, &block::get_latitude> > > >;
+
+  using state_singleton = eosio::singleton<"state"_n, state>;
+
+  using tile_index = instrument::table< eosio::multi_index<"tiles"_n, tile> >;
+
+  using zorder_index = instrument::table< eosio::multi_index<"zorder"_n, zpoint,
+                                          indexed_by< "byzkey"_n, const_mem_fun< zpoint, uint128_t, &zpoint::get_zkey> > > >;
+
+  using page_index = instrument::table< eosio::multi_index<"idpages"_n, page,
+                                        indexed_by< "bystart"_n, const_mem_fun< page, uint128_t, &page::get_start> > > >;
+
+  using currency_index = instrument::table< eosio::multi_index<"stat"_n, stats,
+                                            indexed_by< "byissuer"_n, const_mem_fun< stats, uint64_t, &stats::get_issuer> > > >;
+
+  using token_index = instrument::table< eosio::multi_index<"token"_n, token,
+                                         indexed_by< "byvalidation"_n, const_mem_fun< token, uint64_t, &token::get_validation> >,
+                                         indexed_by< "bycoords"_n, const_mem_fun< token, uint128_t, &token::get_coords_id> > > >;
+
+  using token_v2_index = instrument::table< eosio::multi_index<"tokenv2"_n, token_v2> >;
 
-  using currency_index = eosio::multi_index<"stat"_n, stats,
-                         indexed_by< "byissuer"_n, const_mem_fun< stats, uint64_t, &stats::get_issuer> > >;
+  using validation_index = instrument::table< eosio::multi_index<"valids"_n, validation_ids> >;
 
-  using token_index = eosio::multi_index<"token"_n, token,
-                       indexed_by< "byvalidation"_n, const_mem_fun< token, uint64_t, &token::get_validation> >,
-                       indexed_by< "bycoords"_n, const_mem_fun< token, uint128_t, &token::get_coords_id> > >;
+  using owner_index = instrument::table< eosio::multi_index<"owners"_n, owner_range> >;
 
 private:
-   token_index tokens;
+   token_index tokens;          // rows of the old layout until migratetoken is through
+   token_v2_index tokens_v2;
+   validation_index validations;
+   owner_index owner_ranges;
+   block_index blocks;
+   zorder_index zorder;
 
-   id_type mint(name owner, asset value, point coords, uint64_t validation);
+   void prepare_issue(asset quantity, const string& memo);
+   state get_state();
+   id_type reserve_ids(uint64_t count, uint64_t block_height = 0);
+   uint64_t max_block_height();
+   void mint(id_type id, point coords, uint64_t validation);
+   void log_issue(name to, uint64_t validation, const id_pair& ids);
+   void add_validation_ids(uint64_t validation, const interval_set& ids);
+   static void fill_cursors(state& st);
+   void occupy(const vector<points_pair>& runs);
+   void store_tile(tile_index& tiles, uint64_t key, const vector<uint64_t>& cells);
+   vector<block> overlapping_blocks(const points_pair& area, uint64_t max_height);
+   void check_free(const points_pair& area, uint64_t max_height, bool probe);
+   void check_tiles(const points_pair& area);
+   void probe_coords(const points_pair& area);
+   static vector<points_pair> split_signs(const points_pair& area);
+   token find_token(id_type id);
+   void burn_ids(const interval_set& ids);
+   void clear_tiles(vector<point> cells);
+   void remove_validation_ids(uint64_t validation, const interval_set& ids);
+   static void check_ids(const interval_set& ids, int64_t amount);
 
    interval_set sub_balance(name owner, asset value);
+   void sub_balance(name owner, asset value, const interval_set& ids);
    void add_balance(name owner, asset value, const interval_set& ids );
-   void sub_id( name owner, asset value, id_type id );
+   void add_ids( name owner, symbol_code sym, const interval_set& ids );
+   void set_owner( name owner, const interval_set& ids );
+   name owner_of( id_type id );
+   interval_set sub_ids( name owner, symbol_code sym, int64_t amount );
+   void remove_ids( name owner, symbol_code sym, const interval_set& ids );
+   void store_pages( page_index& pages, symbol_code sym, interval_set::const_iterator begin, interval_set::const_iterator end );
+   void split_page( page_index& pages, const page& pg );
+   void join_page( page_index& pages, const page& pg );
+   void move_legacy_ids( name owner, const account& a );
+   static void clear_legacy_ids( account& a );
    void sub_supply(asset quantity);
    void add_supply(asset quantity);
 };
@@ -0,0 +1,161 @@
+#pragma once
+
+// Opt-in per-action resource counters for ertc and ertc.nft, compiled in
+// with -DERTC_INSTRUMENT (cmake -DERTC_INSTRUMENT=ON). Every instrumented
+// action prints one line to its console when it returns:
+//
+//   #instr nft::issue finds=12 emplaces=130 modifies=3 erases=0 row_bytes=4810 ...
+//
+// bench/instr_report aggregates these lines per action. Without the flag
+// the tables are the plain multi_index types and the macros expand to
+// nothing.
+
+#include <eosio/multi_index.hpp>
+
+#ifdef ERTC_INSTRUMENT
+
+#include <eosio/print.hpp>
+#include <iterator>
+#include <prange.hpp>
+#include <packed_set.hpp>
+
+namespace instrument {
+
+struct counters {
+  uint64_t finds = 0;           // find, get, lower_bound, upper_bound
+  uint64_t emplaces = 0;
+  uint64_t modifies = 0;
+  uint64_t erases = 0;
+  uint64_t row_bytes = 0;       // serialized size of emplaced and modified rows
+  uint64_t sets_in = 0;         // intervals of the sets updated, before
+  uint64_t sets_out = 0;        // and after the update
+  uint64_t cells_checked = 0;   // against the validation polygon
+  uint64_t cells_occupied = 0;  // checked against and marked in the tiles
+  uint64_t cells_minted = 0;    // token rows written
+
+  static counters& current() {
+    static counters c;
+    return c;
+  }
+};
+
+inline uint64_t intervals(const interval_set& ids) { return ids.size(); }
+inline uint64_t intervals(const packed_interval_set& ids) { return std::distance(ids.begin(), ids.end()); }
+
+// Resets the counters and prints them once the action is through. Inline
+// actions and notifications run after it, each with a record of its own.
+class action_record {
+public:
+  explicit action_record(const char* action) : action(action) { counters::current() = counters{}; }
+  ~action_record() {
+    const auto& c = counters::current();
+    eosio::print("#instr ", action, " finds=", c.finds, " emplaces=", c.emplaces, " modifies=", c.modifies,
+                 " erases=", c.erases, " row_bytes=", c.row_bytes, " sets_in=", c.sets_in, " sets_out=", c.sets_out,
+                 " cells_checked=", c.cells_checked, " cells_occupied=", c.cells_occupied,
+                 " cells_minted=", c.cells_minted, "\n");
+  }
+
+private:
+  const char* action;
+};
+
+template<typename Updater>
+auto counting(Updater& updater) {
+  return [&updater](auto& row) {
+    updater(row);
+    counters::current().row_bytes += eosio::pack_size(row);
+  };
+}
+
+// Secondary index of a counted table.
+template<typename Index>
+class counted_index : public Index {
+public:
+  using typename Index::const_iterator;
+  using key_type = typename Index::secondary_key_type;
+
+  explicit counted_index(const Index& idx) : Index(idx) {}
+
+  const_iterator find(const key_type& key) const { ++counters::current().finds; return Index::find(key); }
+  const_iterator lower_bound(const key_type& key) const { ++counters::current().finds; return Index::lower_bound(key); }
+  const_iterator upper_bound(const key_type& key) const { ++counters::current().finds; return Index::upper_bound(key); }
+
+  template<typename Lambda>
+  void modify(const_iterator itr, eosio::name payer, Lambda&& updater) {
+    ++counters::current().modifies;
+    Index::modify(itr, payer, counting(updater));
+  }
+
+  const_iterator erase(const_iterator itr) { ++counters::current().erases; return Index::erase(itr); }
+};
+
+// multi_index that counts its row operations into counters::current().
+template<typename Table>
+class counted_table : public Table {
+public:
+  using typename Table::const_iterator;
+  using row_type = std::decay_t<decltype(*std::declval<const_iterator>())>;
+
+  using Table::Table;
+
+  const_iterator find(uint64_t primary) const { ++counters::current().finds; return Table::find(primary); }
+  const_iterator lower_bound(uint64_t primary) const { ++counters::current().finds; return Table::lower_bound(primary); }
+  const_iterator upper_bound(uint64_t primary) const { ++counters::current().finds; return Table::upper_bound(primary); }
+  const row_type& get(uint64_t primary, const char* error_msg = "unable to find key") const {
+    ++counters::current().finds;
+    return Table::get(primary, error_msg);
+  }
+
+  template<typename Lambda>
+  const_iterator emplace(eosio::name payer, Lambda&& constructor) {
+    ++counters::current().emplaces;
+    return Table::emplace(payer, counting(constructor));
+  }
+
+  template<typename Lambda>
+  void modify(const_iterator itr, eosio::name payer, Lambda&& updater) {
+    ++counters::current().modifies;
+    Table::modify(itr, payer, counting(updater));
+  }
+
+  template<typename Lambda>
+  void modify(const row_type& obj, eosio::name payer, Lambda&& updater) {
+    ++counters::current().modifies;
+    Table::modify(obj, payer, counting(updater));
+  }
+
+  const_iterator erase(const_iterator itr) { ++counters::current().erases; return Table::erase(itr); }
+  void erase(const row_type& obj) { ++counters::current().erases; Table::erase(obj); }
+
+  template<eosio::name::raw IndexName>
+  auto get_index() {
+    return counted_index<decltype(Table::template get_index<IndexName>())>(Table::template get_index<IndexName>());
+  }
+
+  template<eosio::name::raw IndexName>
+  auto get_index() const {
+    return counted_index<decltype(Table::template get_index<IndexName>())>(Table::template get_index<IndexName>());
+  }
+};
+
+template<typename Table>
+using table = counted_table<Table>;
+
+}
+
+#define INSTRUMENT_ACTION(action) instrument::action_record instrument_record_(action)
+#define INSTRUMENT_COUNT(field, n) (instrument::counters::current().field += (n))
+
+#else
+
+namespace instrument {
+
+template<typename Table>
+using table = Table;
+
+}
+
+#define INSTRUMENT_ACTION(action)
+#define INSTRUMENT_COUNT(field, n) ((void)0)
+
+#endif
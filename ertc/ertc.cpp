@@ -1,6 +1,8 @@
 // ertc
 
 #include "ertc.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <numeric>
 #include <string>
 #include <ertc.nft.hpp>
@@ -9,14 +11,19 @@ using namespace std::literals;
 namespace ertc {
 
    bool validate_coordinates(const std::vector<point>& coords) {
-      return coords.size() >= 3;
+      if (coords.size() < 3)
+        return false;
+      return std::all_of(coords.begin(), coords.end(), [](const point& pt){
+        return std::abs(pt.latitude) <= MAX_RASTER_COORD && std::abs(pt.longitude) <= MAX_RASTER_COORD;
+      });
    }
 
    ertc::ertc(eosio::name receiver, eosio::name code, eosio::datastream<const char *> ds)
    : contract(receiver, code, ds),
      validations(receiver, receiver.value),
      parameters(receiver, receiver.value),
-     current_validation(receiver, receiver.value)
+     issuances(receiver, receiver.value),
+     plans(receiver, receiver.value)
    {}
 
    void ertc::create(eosio::name creator, uint64_t id, const std::vector<point>& coords, int64_t amount) {
@@ -65,92 +72,270 @@ namespace ertc {
    void ertc::preissue(uint64_t id) {
      require_auth(_self);
 
-     currentstate current;
-     if (current_validation.exists()) {
-       current = current_validation.get();
-       eosio::check(current.id != id, "validation id already preissued");
-       eosio::check(current.state == validation::completed || current.state == validation::canceled, "pending validation is not complete");
-     }
-
      auto it = validations.find(id);
      eosio::check(it != validations.end(), "validation does not exist");
      eosio::check(it->state == validation::validated, "wrong validation state");
+     eosio::check(issuances.find(id) == issuances.end(), "validation id already preissued");
 
-     current = {id, 0, it->state};
-     current_validation.set(current, _self);
-
-     auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
-     auto ext_sym = params.fund_symbol;
-     nft::account_index accounts( ext_sym.get_contract(), _self.value );
-     auto acc_it = accounts.find( ext_sym.get_symbol().code().raw() );
-     if (acc_it != accounts.end())
-       eosio::check(acc_it->balance.amount == 0, "contract balance must be zero");
+     issuances.emplace(_self, [&](auto &fields) {
+        fields.id = id;
+        fields.issued = 0;
+     });
    }
 
    void ertc::issue(uint64_t id, int64_t amount, const std::vector<point>& points) {
+      INSTRUMENT_ACTION("ertc::issue");
+      require_auth(_self);
+
+      size_t points_size = points.size();
+      eosio::check(amount == points_size, "issue amount and points mismatch");
+      const auto& v = record_issue(id, amount);
+      send_issue(v, encode_points(points), amount);
+   }
+
+   void ertc::issuepacked(uint64_t id, int64_t amount, const packed_points& cells) {
+      INSTRUMENT_ACTION("ertc::issuepacked");
+      require_auth(_self);
+
+      uint64_t cells_size = 0;
+      for (const auto& run: cells) {
+        eosio::check(run.first.longitude <= run.second.longitude, "invalid cell run");
+        cells_size += uint64_t(run.second.longitude) - uint64_t(run.first.longitude) + 1;
+        eosio::check(cells_size <= uint64_t(amount), "issue amount and points mismatch");
+      }
+      eosio::check(uint64_t(amount) == cells_size, "issue amount and points mismatch");
+      const auto& v = record_issue(id, amount);
+      send_issue(v, cells, amount);
+   }
+
+   void ertc::issuerect(uint64_t id, int64_t amount, const std::vector<points_pair>& areas) {
+      INSTRUMENT_ACTION("ertc::issuerect");
+      require_auth(_self);
+
+      size_t points_size = std::accumulate(areas.begin(), areas.end(), 0ull, [](const auto& acc, const auto& elem){
+        return acc + points_range_length(elem);
+      });
+      eosio::check(uint64_t(amount) == points_size, "issue amount and points mismatch");
+
+      // blocks are checked like the cells of the other paths, one span per
+      // row of every area
+      auto it = validations.find(id);
+      eosio::check(it != validations.end(), "validation does not exist");
+      std::vector<points_pair> rows;
+      for (const auto& area: areas) {
+        auto range = normalize_range(area);
+        uint64_t height = uint64_t(range.second.latitude) - uint64_t(range.first.latitude);
+        eosio::check(height < nft::MAX_BLOCK_SIDE, "area is too large");
+        for (int64_t lat = range.first.latitude; lat <= range.first.latitude + int64_t(height); ++lat)
+          rows.push_back({{lat, range.first.longitude}, {lat, range.second.longitude}});
+      }
+      INSTRUMENT_COUNT(cells_checked, amount);
+      eosio::check(spans_inside(it->coordinates, rows), "points outside of the validation area");
+      const auto& v = record_issue(id, amount);
+
+      auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
+
+      eosio::action( eosio::permission_level{ _self, "active"_n},
+                     params.fund_symbol.get_contract(),
+                     "issuerect"_n,
+                     std::make_tuple(_self, eosio::asset{amount, params.fund_symbol.get_symbol()}, areas, v.id, ""s)
+                  ).send();
+   }
+
+   void ertc::plancells(uint64_t id, const std::vector<points_pair>& areas) {
       require_auth(_self);
 
       auto it = validations.find(id);
       eosio::check(it != validations.end(), "validation does not exist");
       eosio::check(it->state == validation::validated, "wrong validation state");
+      auto pending = issuances.find(id);
+      eosio::check(pending != issuances.end(), "validation id was not preissued");
+      eosio::check(plans.find(id) == plans.end(), "validation cells already planned");
+
+      std::vector<points_pair> normalized;
+      normalized.reserve(areas.size());
+      int64_t cells = 0;
+      for (const auto& area: areas) {
+        auto range = normalize_range(area);
+        eosio::check(uint64_t(range.second.latitude) - uint64_t(range.first.latitude) < nft::MAX_BLOCK_SIDE &&
+                     uint64_t(range.second.longitude) - uint64_t(range.first.longitude) < nft::MAX_BLOCK_SIDE, "area is too large");
+        cells += points_range_length(range);
+        normalized.push_back(range);
+      }
+      eosio::check(cells > 0, "no cells to issue");
+      eosio::check(cells == it->amount - pending->issued, "planned cells and amount left mismatch");
+
+      plans.emplace(_self, [&](auto &fields) {
+         fields.id = id;
+         fields.areas = std::move(normalized);
+         fields.area = 0;
+         fields.offset = 0;
+      });
+   }
 
-      auto current = current_validation.get();
-      eosio::check(current.id == id, "validation id was not preissued");
-      eosio::check(current.issued < it->amount, "validation already fully issued");
+   void ertc::planpolygon(uint64_t id) {
+      require_auth(_self);
 
-      /*size_t points_size = std::accumulate(points.begin(), points.end(), 0ull, [](const auto& acc, const auto& elem){
-        return acc + points_range_length(elem);
-      });*/
-      size_t points_size = points.size();
-      eosio::check(amount == points_size, "issue amount and points mismatch");
-      eosio::check(amount <= it->amount - current.issued, "too big issue amount");
+      auto it = validations.find(id);
+      eosio::check(it != validations.end(), "validation does not exist");
+      eosio::check(it->state == validation::validated, "wrong validation state");
+      auto pending = issuances.find(id);
+      eosio::check(pending != issuances.end(), "validation id was not preissued");
+      eosio::check(pending->issued == 0, "validation is partially issued");
+      eosio::check(plans.find(id) == plans.end(), "validation cells already planned");
+
+      auto spans = rasterize_polygon(it->coordinates);
+      int64_t cells = std::accumulate(spans.begin(), spans.end(), int64_t(0), [](int64_t acc, const auto& span){
+        return acc + int64_t(span.second.longitude - span.first.longitude) + 1;
+      });
+      eosio::check(cells == it->amount, "polygon cells and amount mismatch");
 
-      // issue tokens
+      plans.emplace(_self, [&](auto &fields) {
+         fields.id = id;
+         fields.areas = std::move(spans);
+         fields.area = 0;
+         fields.offset = 0;
+      });
+   }
+
+   void ertc::issuestep(uint64_t id) {
+      INSTRUMENT_ACTION("ertc::issuestep");
+      require_auth(_self);
+
+      auto plan = plans.find(id);
+      eosio::check(plan != plans.end(), "validation has no planned cells");
+
+      // cells come row by row, so most of them share tiles with the ones
+      // before them and cost only their own rows
+      packed_points cells;
+      points_encoder out(cells);
+      int64_t count = 0;
+      std::vector<uint64_t> tiles;
+      int64_t budget = STEP_BUDGET;
+      uint32_t area = plan->area;
+      uint64_t offset = plan->offset;
+      while (area < plan->areas.size()) {
+        const auto& range = plan->areas[area];
+        auto pt = range_point(range, offset);
+        auto key = nft::tile::key_of(pt);
+        int64_t cost = CELL_COST;
+        if (std::find(tiles.begin(), tiles.end(), key) == tiles.end())
+          cost += TILE_COST;
+        if (cost > budget)
+          break;
+
+        budget -= cost;
+        if (cost > CELL_COST)
+          tiles.push_back(key);
+        out.push(pt);
+        ++count;
+        if (++offset == points_range_length(range)) {
+          ++area;
+          offset = 0;
+        }
+      }
+
+      out.finish();
+
+      const auto& v = record_issue(id, count);
+      send_issue(v, cells, count);
+
+      if (area == plan->areas.size()) {
+        plans.erase(plan);
+      } else {
+        plans.modify(plan, _self, [&](auto &fields) {
+           fields.area = area;
+           fields.offset = offset;
+        });
+      }
+   }
+
+   // Every issued cell has to lie in the validated polygon. The cells go on
+   // packed as they are.
+   void ertc::send_issue(const validation& v, const packed_points& cells, int64_t amount) {
+      std::vector<points_pair> runs(cells.begin(), cells.end());
+      INSTRUMENT_COUNT(cells_checked, amount);
+      eosio::check(spans_inside(v.coordinates, runs), "points outside of the validation area");
       auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
 
       eosio::action( eosio::permission_level{ _self, "active"_n},
                      params.fund_symbol.get_contract(),
-                     "issue"_n,
-                     std::make_tuple(_self, eosio::asset{points_size, params.fund_symbol.get_symbol()}, points, it->id, ""s)
+                     "issuepacked"_n,
+                     std::make_tuple(_self, eosio::asset{amount, params.fund_symbol.get_symbol()}, cells, v.id, ""s)
                   ).send();
+   }
+
+   // Checks `amount` more tokens against the preissued validation and
+   // counts them as issued.
+   const ertc::validation& ertc::record_issue(uint64_t id, int64_t amount) {
+      auto it = validations.find(id);
+      eosio::check(it != validations.end(), "validation does not exist");
+      eosio::check(it->state == validation::validated, "wrong validation state");
+
+      auto pending = issuances.find(id);
+      eosio::check(pending != issuances.end(), "validation id was not preissued");
+      eosio::check(pending->issued < it->amount, "validation already fully issued");
+      eosio::check(amount <= it->amount - pending->issued, "too big issue amount");
 
-      current.issued += amount;
-      current_validation.set(current, _self);
+      issuances.modify(pending, _self, [&](auto &fields) {
+         fields.issued += amount;
+      });
+      return *it;
+   }
+
+   // The token contract reports the ids of every issue, the ones issued to
+   // us are held for their validation until payout.
+   void ertc::onissue(eosio::name to, uint64_t validation, const interval_set& ids) {
+      INSTRUMENT_ACTION("ertc::onissue");
+      auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
+      if (get_first_receiver() != params.fund_symbol.get_contract() || to != _self)
+        return;
+
+      auto pending = issuances.find(validation);
+      eosio::check(pending != issuances.end(), "validation id was not preissued");
+      issuances.modify(pending, _self, [&](auto &fields) {
+         INSTRUMENT_COUNT(sets_in, fields.ids.size());
+         merge_sets(fields.ids, ids.begin(), ids.end());
+         INSTRUMENT_COUNT(sets_out, fields.ids.size());
+      });
    }
 
    void ertc::payout(uint64_t id) {
+     INSTRUMENT_ACTION("ertc::payout");
      require_auth(_self);
 
      auto it = validations.find(id);
      eosio::check(it != validations.end(), "validation does not exist");
      eosio::check(it->state == validation::validated, "wrong validation state");
 
-     auto current = current_validation.get();
-     eosio::check(current.id == id, "validation id is not pending");
-     eosio::check(current.issued == it->amount, "validation is not fully issued");
+     auto pending = issuances.find(id);
+     eosio::check(pending != issuances.end(), "validation id is not pending");
+     eosio::check(pending->issued == it->amount, "validation is not fully issued");
 
      auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
      int64_t fund_cut = it->amount * params.fund_share / 100;
      int64_t creator_cut = it->amount - fund_cut;
 
-     eosio::action( eosio::permission_level{ _self, "active"_n},
-                    params.fund_symbol.get_contract(),
-                    "transfer"_n,
-                    std::make_tuple(_self, params.fund_account, eosio::asset{fund_cut, params.fund_symbol.get_symbol()}, ""s)
-                 ).send();
-
-     eosio::action( eosio::permission_level{ _self, "active"_n},
-                    params.fund_symbol.get_contract(),
-                    "transfer"_n,
-                    std::make_tuple(_self, it->creator, eosio::asset{creator_cut, params.fund_symbol.get_symbol()}, ""s)
-                 ).send();
+     // the ids of this validation only, others may still be in progress;
+     // the creator gets the low ones and the fund the rest
+     std::vector<std::pair<eosio::name, eosio::asset>> transfers;
+     if (creator_cut > 0)
+       transfers.push_back({it->creator, eosio::asset{creator_cut, params.fund_symbol.get_symbol()}});
+     if (fund_cut > 0)
+       transfers.push_back({params.fund_account, eosio::asset{fund_cut, params.fund_symbol.get_symbol()}});
+
+     if (!transfers.empty()) {
+       eosio::action( eosio::permission_level{ _self, "active"_n},
+                      params.fund_symbol.get_contract(),
+                      "transferbatch"_n,
+                      std::make_tuple(_self, transfers, pending->ids, ""s)
+                   ).send();
+     }
 
      validations.modify(it, _self, [&](auto &fields) {
         fields.state = validation::completed;
      });
-
-     current.state = validation::completed;
-     current_validation.set(current, _self);
+     issuances.erase(pending);
    }
 
    void ertc::newshare(uint8_t value) {
@@ -173,19 +358,93 @@ namespace ertc {
         fields.state = validation::canceled;
      });
 
-     currentstate current;
-     if (current_validation.exists()) {
-       current = current_validation.get();
-       if (current.id == id) {
-         if (current.issued > 0) {
-           current.state = validation::canceled;
-           current_validation.set(current, _self);
-         } else {
-           current_validation.remove();
-           validations.erase(it);
-         }
+     auto plan = plans.find(id);
+     if (plan != plans.end())
+       plans.erase(plan);
+
+     // issued tokens stay held under their validation
+     auto pending = issuances.find(id);
+     if (pending != issuances.end() && pending->issued == 0) {
+       issuances.erase(pending);
+       validations.erase(it);
+     }
+   }
+
+   void ertc::gcvalidation(uint64_t id, uint32_t limit) {
+     INSTRUMENT_ACTION("ertc::gcvalidation");
+     require_auth(_self);
+     eosio::check(limit > 0, "limit must be positive");
+
+     auto it = validations.find(id);
+     eosio::check(it != validations.end(), "validation does not exist");
+     eosio::check(it->state == validation::canceled, "validation is not canceled");
+
+     auto pending = issuances.find(id);
+     eosio::check(pending != issuances.end(), "validation has no tokens left");
+
+     auto rest = pending->ids;
+     int64_t held = 0;
+     for (const auto& range: rest)
+       held += range.second - range.first + 1;
+     int64_t amount = std::min<int64_t>(held, limit);
+     auto burned = substract_amount(rest, amount);
+
+     auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
+     if (amount > 0) {
+       eosio::action( eosio::permission_level{ _self, "active"_n},
+                      params.fund_symbol.get_contract(),
+                      "retire"_n,
+                      std::make_tuple(_self, eosio::asset{amount, params.fund_symbol.get_symbol()}, burned, "canceled validation"s)
+                   ).send();
+     }
+
+     if (rest.empty()) {
+       issuances.erase(pending);
+       validations.erase(it);
+     } else {
+       issuances.modify(pending, _self, [&](auto &fields) {
+          fields.issued -= amount;
+          fields.ids = std::move(rest);
+       });
+     }
+   }
+
+   void ertc::migrate() {
+     require_auth(_self);
+
+     current_singleton current_validation(_self, _self.value);
+     eosio::check(current_validation.exists(), "nothing to migrate");
+     auto current = current_validation.get();
+
+     if (current.state != validation::completed && issuances.find(current.id) == issuances.end()) {
+       // older versions required a zero balance to preissue, so everything
+       // the contract holds was issued for this validation
+       auto params = parameters.get_or_create(_self, DEFAULT_PARAMS);
+       auto sym = params.fund_symbol.get_symbol().code();
+       interval_set held;
+
+       nft::page_index pages(params.fund_symbol.get_contract(), _self.value);
+       auto by_start = pages.get_index<"bystart"_n>();
+       for (auto pg = by_start.lower_bound(nft::page::page_key(sym, 0)); pg != by_start.end() && pg->sym == sym; ++pg) {
+         auto ids = decode_intervals(pg->tokens);
+         merge_sets(held, ids.cbegin(), ids.cend());
        }
+
+       nft::account_index accounts(params.fund_symbol.get_contract(), _self.value);
+       auto acc_it = accounts.find(sym.raw());
+       if (acc_it != accounts.end()) {
+         auto legacy = acc_it->packed_tokens.has_value() ? decode_intervals(acc_it->packed_tokens.value())
+                                                         : acc_it->tokens.value_or(interval_set{});
+         merge_sets(held, legacy.cbegin(), legacy.cend());
+       }
+
+       issuances.emplace(_self, [&](auto &fields) {
+          fields.id = current.id;
+          fields.issued = current.issued;
+          fields.ids = std::move(held);
+       });
      }
+     current_validation.remove();
    }
 
 }
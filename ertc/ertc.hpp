@@ -6,6 +6,9 @@
 #include <eosio/singleton.hpp>
 #include <eosio/time.hpp>
 #include <prange.hpp>
+#include <packed_set.hpp>
+#include <raster.hpp>
+#include <instrument.hpp>
 
 namespace ertc {
 
@@ -48,6 +51,28 @@ namespace ertc {
       [[eosio::action]]
       void issue(uint64_t id, int64_t amount, const std::vector<point>& points);
 
+      // Same as issue with the points in packed form.
+      [[eosio::action]]
+      void issuepacked(uint64_t id, int64_t amount, const packed_points& cells);
+
+      [[eosio::action]]
+      void issuerect(uint64_t id, int64_t amount, const std::vector<points_pair>& areas);
+
+      // Commits the cells of a preissued validation still to be issued,
+      // the areas row by row, for issuestep to go through.
+      [[eosio::action]]
+      void plancells(uint64_t id, const std::vector<points_pair>& areas);
+
+      // Plans the cells of the validation polygon, which must be as many
+      // as its amount. Nothing may be issued for it yet.
+      [[eosio::action]]
+      void planpolygon(uint64_t id);
+
+      // Issues the next planned cells of a validation, as many as fit
+      // STEP_BUDGET. Repeated until the plan is done.
+      [[eosio::action]]
+      void issuestep(uint64_t id);
+
       [[eosio::action]]
       void payout(uint64_t id);
 
@@ -57,6 +82,41 @@ namespace ertc {
       [[eosio::action]]
       void cancel(uint64_t id);
 
+      // Burns up to `limit` of the ids a canceled validation issued, the
+      // ones left stay in its issuance row for the next call. The
+      // validation goes with the last of them.
+      [[eosio::action]]
+      void gcvalidation(uint64_t id, uint32_t limit);
+
+      // Moves a pending validation of the currentstate singleton into the
+      // issuance table.
+      [[eosio::action]]
+      void migrate();
+
+      [[eosio::on_notify("*::issuelog")]]
+      void onissue(eosio::name to, uint64_t validation, const interval_set& ids);
+
+      // Progress of a preissued validation and the token ids issued for it
+      // that the contract holds until payout.
+      struct [[eosio::table]] issuance {
+        uint64_t id;
+        int64_t issued;
+        interval_set ids;
+
+        uint64_t primary_key() const { return id; }
+      };
+
+      // Cells issuestep has yet to issue, from `offset` of areas[area] on.
+      struct [[eosio::table]] issueplan {
+        uint64_t id;
+        std::vector<points_pair> areas;
+        uint32_t area;
+        uint64_t offset;
+
+        uint64_t primary_key() const { return id; }
+      };
+
+      // Single pending validation of older versions, read by migrate only.
       struct [[eosio::table]] currentstate {
         uint64_t id;
         int64_t issued;
@@ -69,17 +129,32 @@ namespace ertc {
         eosio::name fund_account;
       };
 
+      // decimal digits of a coordinate; a grid cell is one unit of the last
+      static constexpr uint8_t POINT_DIGITS = 8;
+
+      // Cost model of issuestep in database operations: a token and its
+      // zorder row with their indexes per cell, a tile read, write and
+      // block query per tile. A step stays well inside the CPU limit.
+      static constexpr int64_t CELL_COST = 5;
+      static constexpr int64_t TILE_COST = 3;
+      static constexpr int64_t STEP_BUDGET = 5000;
+
    private:
 
-      typedef eosio::multi_index<"validation"_n, validation> validation_index;
+      const validation& record_issue(uint64_t id, int64_t amount);
+      void send_issue(const validation& v, const packed_points& cells, int64_t amount);
+
+      typedef instrument::table<eosio::multi_index<"validation"_n, validation>> validation_index;
       typedef eosio::singleton<"params"_n, params> params_singleton;
+      typedef instrument::table<eosio::multi_index<"issuance"_n, issuance>> issuance_index;
+      typedef instrument::table<eosio::multi_index<"issueplan"_n, issueplan>> plan_index;
       typedef eosio::singleton<"currentstate"_n, currentstate> current_singleton;
 
       validation_index validations;
       params_singleton parameters;
-      current_singleton current_validation;
+      issuance_index issuances;
+      plan_index plans;
 
-      static constexpr uint8_t POINT_DIGITS = 8;
       static constexpr params DEFAULT_PARAMS{.fund_share = 40, .fund_symbol = {{"ERTC", 0}, "ertc.nft"_n}, .fund_account = "ertc.fund"_n};
    };
 
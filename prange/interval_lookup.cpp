@@ -0,0 +1,87 @@
+#include "interval_lookup.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+constexpr id_type NO_ID = std::numeric_limits<id_type>::max();
+
+// Searches run together in the batch kernel. They stay scalar: every lane
+// loads a different slot, SSE2 has neither a gather nor an unsigned 64-bit
+// compare to put them in one register with, and the time goes into the
+// cache misses the lockstep already overlaps.
+constexpr size_t LANES = 8;
+
+// the ids of the slots three levels down from k share a cache line
+inline void prefetch_below(const id_type* starts, size_t k) {
+  __builtin_prefetch(starts + 8 * k);
+}
+
+// every right turn went to a start at or before the id, the last one is its
+// predecessor; the trailing left turns are dropped with it
+inline size_t last_right_turn(size_t k) {
+  return k >> (__builtin_ctzll(k) + 1);
+}
+
+}
+
+interval_lookup::interval_lookup(const interval_set& ids) : intervals(ids.size()) {
+  while ((size_t(1) << height) <= intervals)
+    ++height;
+
+  // padding starts are never at or before an id, except for the largest
+  // one, then the padding has to answer like the last interval does
+  bool holds_last = !ids.empty() && ids.back().second == NO_ID;
+  starts.assign(size_t(1) << height, NO_ID);
+  ends.assign(size_t(1) << height, holds_last ? NO_ID : 0);
+  ends[0] = 0;
+  fill(ids, 0, 1);
+}
+
+// in-order walk of the implicit tree, handing out the sorted intervals
+size_t interval_lookup::fill(const interval_set& ids, size_t next, size_t slot) {
+  if (slot > intervals)
+    return next;
+  next = fill(ids, next, 2 * slot);
+  starts[slot] = ids[next].first;
+  ends[slot] = ids[next].second;
+  return fill(ids, next + 1, 2 * slot + 1);
+}
+
+size_t interval_lookup::descend(id_type id) const {
+  const id_type* s = starts.data();
+  size_t k = 1;
+  for (size_t level = 0; level < height; ++level) {
+    prefetch_below(s, k);
+    k = 2 * k + (s[k] <= id);
+  }
+  return last_right_turn(k);
+}
+
+bool interval_lookup::contains(id_type id) const {
+  size_t slot = descend(id);
+  return starts[slot] <= id && id <= ends[slot];
+}
+
+void interval_lookup::contains(const id_type* ids, size_t count, bool* found) const {
+  const id_type* s = starts.data();
+  size_t k[LANES];
+  for (size_t base = 0; base < count; base += LANES) {
+    size_t lanes = std::min(LANES, count - base);
+    const id_type* group = ids + base;
+
+    std::fill(k, k + LANES, size_t(1));
+    // one level for every lane before the next, the paths have the same
+    // length so there is nothing to branch on
+    for (size_t level = 0; level < height; ++level) {
+      for (size_t j = 0; j < lanes; ++j) {
+        prefetch_below(s, k[j]);
+        k[j] = 2 * k[j] + (s[k[j]] <= group[j]);
+      }
+    }
+    for (size_t j = 0; j < lanes; ++j) {
+      size_t slot = last_right_turn(k[j]);
+      found[base + j] = starts[slot] <= group[j] && group[j] <= ends[slot];
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "prange.hpp"
+
+// Read-only membership index over an interval_set, for checking many ids
+// against one large holder. The interval starts are kept apart from the
+// ends in Eytzinger (breadth-first tree) order, so the first levels of
+// every search share a few cache lines and the next ones can be
+// prefetched, where a lower_bound over the pairs misses on almost every
+// step. Built once in O(n), it does not follow changes to the set.
+class interval_lookup {
+public:
+  explicit interval_lookup(const interval_set& ids);
+
+  bool contains(id_type id) const;
+  // found[i] = contains(ids[i]); the searches run in lockstep groups so
+  // their cache misses overlap
+  void contains(const id_type* ids, size_t count, bool* found) const;
+
+  size_t size() const { return intervals; }
+
+private:
+  size_t fill(const interval_set& ids, size_t next, size_t slot);
+  // slot of the interval with the last start at or before id, 0 if none
+  size_t descend(id_type id) const;
+
+  size_t intervals = 0;
+  size_t height = 0;
+  // slot k has children 2k and 2k + 1, slot 0 matches nothing and slots
+  // past the last interval are padding that every search passes on the left
+  std::vector<id_type> starts;
+  std::vector<id_type> ends;
+};
@@ -0,0 +1,112 @@
+#include "morton.hpp"
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t SIGN = 1ull << 63;
+
+uint64_t spread(uint32_t x) {
+  uint64_t v = x;
+  v = (v | v << 16) & 0x0000ffff0000ffffull;
+  v = (v | v << 8)  & 0x00ff00ff00ff00ffull;
+  v = (v | v << 4)  & 0x0f0f0f0f0f0f0f0full;
+  v = (v | v << 2)  & 0x3333333333333333ull;
+  v = (v | v << 1)  & 0x5555555555555555ull;
+  return v;
+}
+
+uint32_t compact(uint64_t v) {
+  v &= 0x5555555555555555ull;
+  v = (v | v >> 1)  & 0x3333333333333333ull;
+  v = (v | v >> 2)  & 0x0f0f0f0f0f0f0f0full;
+  v = (v | v >> 4)  & 0x00ff00ff00ff00ffull;
+  v = (v | v >> 8)  & 0x0000ffff0000ffffull;
+  v = (v | v >> 16) & 0x00000000ffffffffull;
+  return uint32_t(v);
+}
+
+zkey_type spread64(uint64_t x) {
+  return (zkey_type(spread(uint32_t(x >> 32))) << 64) | spread(uint32_t(x));
+}
+
+uint64_t compact64(zkey_type v) {
+  return (uint64_t(compact(uint64_t(v >> 64))) << 32) | compact(uint64_t(v));
+}
+
+zkey_type interleave(uint64_t lat, uint64_t lon) {
+  return spread64(lat) << 1 | spread64(lon);
+}
+
+// A quadrant: 2^level x 2^level unsigned cells from (lat, lon).
+struct quad {
+  uint64_t lat;
+  uint64_t lon;
+  unsigned level;
+
+  uint64_t extent() const { return level == 64 ? ~0ull : (1ull << level) - 1; }
+
+  zkey_range keys() const {
+    zkey_type first = interleave(lat, lon);
+    zkey_type span = level == 64 ? ~zkey_type(0) : (zkey_type(1) << (2 * level)) - 1;
+    return {first, first | span};
+  }
+};
+
+}
+
+zkey_type morton_key(const point& pt) {
+  return interleave(uint64_t(pt.latitude) ^ SIGN, uint64_t(pt.longitude) ^ SIGN);
+}
+
+point morton_point(zkey_type key) {
+  return {int64_t(compact64(key >> 1) ^ SIGN), int64_t(compact64(key) ^ SIGN)};
+}
+
+std::vector<zkey_range> morton_ranges(const points_pair& box, size_t max_ranges) {
+  const uint64_t lat_lo = uint64_t(box.first.latitude) ^ SIGN, lat_hi = uint64_t(box.second.latitude) ^ SIGN;
+  const uint64_t lon_lo = uint64_t(box.first.longitude) ^ SIGN, lon_hi = uint64_t(box.second.longitude) ^ SIGN;
+
+  // start from the smallest quadrant holding the whole box
+  uint64_t differ = (lat_lo ^ lat_hi) | (lon_lo ^ lon_hi);
+  unsigned top = 0;
+  while (top < 64 && (differ >> top)) ++top;
+  uint64_t mask = top == 64 ? 0 : ~((1ull << top) - 1);
+
+  std::vector<zkey_range> result;
+  std::vector<quad> partial{{lat_lo & mask, lon_lo & mask, top}}, next;
+  result.reserve(max_ranges);
+  next.reserve(max_ranges);
+
+  // refine level by level, so a budget cut leaves a uniformly coarse border
+  while (!partial.empty() && partial.front().level > 0
+         && result.size() + 4 * partial.size() <= max_ranges) {
+    next.clear();
+    for (const auto& q: partial) {
+      unsigned level = q.level - 1;
+      uint64_t half = 1ull << level;
+      for (int i = 0; i < 4; ++i) {
+        quad child{q.lat + (i & 2 ? half : 0), q.lon + (i & 1 ? half : 0), level};
+        uint64_t lat_end = child.lat + child.extent(), lon_end = child.lon + child.extent();
+        if (lat_end < lat_lo || child.lat > lat_hi || lon_end < lon_lo || child.lon > lon_hi)
+          continue;
+        if (lat_lo <= child.lat && lat_end <= lat_hi && lon_lo <= child.lon && lon_end <= lon_hi)
+          result.push_back(child.keys());
+        else
+          next.push_back(child);
+      }
+    }
+    partial.swap(next);
+  }
+  for (const auto& q: partial)
+    result.push_back(q.keys());
+
+  std::sort(result.begin(), result.end());
+  std::vector<zkey_range> merged;
+  for (const auto& range: result) {
+    if (!merged.empty() && merged.back().second + 1 == range.first)
+      merged.back().second = range.second;
+    else
+      merged.push_back(range);
+  }
+  return merged;
+}
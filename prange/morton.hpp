@@ -0,0 +1,19 @@
+#pragma once
+
+#include "prange.hpp"
+
+// Z-order (Morton) keys: the bits of latitude and longitude, shifted to
+// unsigned so that order is kept, interleaved with latitude on the odd
+// bits. Points close on the map mostly get close keys, so a box maps to a
+// handful of key intervals.
+typedef unsigned __int128 zkey_type;
+typedef std::pair<zkey_type, zkey_type> zkey_range;
+
+zkey_type morton_key(const point& pt);
+point morton_point(zkey_type key);
+
+// Key intervals, sorted and disjoint, that together hold every point of
+// the normalized `box`. Quadrants crossing the border of the box are split
+// until there would be more than `max_ranges` intervals, so the intervals
+// may also hold some points outside of it.
+std::vector<zkey_range> morton_ranges(const points_pair& box, size_t max_ranges = 64);
@@ -0,0 +1,245 @@
+#include "packed_set.hpp"
+#include <algorithm>
+
+namespace {
+
+void write_varint(std::vector<char>& out, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value) byte |= 0x80;
+    out.push_back(static_cast<char>(byte));
+  } while (value);
+}
+
+// stops at `last` on truncated input
+uint64_t read_varint(const char*& pos, const char* last) {
+  uint64_t value = 0;
+  for (unsigned shift = 0; pos != last && shift < 64; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*pos++);
+    value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  return value;
+}
+
+uint64_t zigzag(int64_t from, int64_t to) {
+  int64_t delta = int64_t(uint64_t(to) - uint64_t(from));
+  return (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+}
+
+int64_t unzigzag(int64_t from, uint64_t value) {
+  return int64_t(uint64_t(from) + ((value >> 1) ^ (0 - (value & 1))));
+}
+
+id_type interval_size(const id_pair& range) {
+  return range.second - range.first + 1;
+}
+
+}
+
+packed_interval_set::const_iterator::const_iterator(const char* pos, const char* end)
+: start(pos), next(pos), last(end) {
+  decode();
+}
+
+packed_interval_set::const_iterator& packed_interval_set::const_iterator::operator++() {
+  start = next;
+  base = current.second + 1;
+  decode();
+  return *this;
+}
+
+void packed_interval_set::const_iterator::decode() {
+  if (start == last) return;
+  current.first = base + read_varint(next, last);
+  current.second = current.first + read_varint(next, last);
+}
+
+void interval_encoder::push(const id_pair& range) {
+  write_varint(out, range.first - base);
+  write_varint(out, range.second - range.first);
+  base = range.second + 1;
+}
+
+void interval_encoder::append_encoded(const char* first, const char* last, id_type last_end) {
+  if (first == last) return;
+  out.insert(out.end(), first, last);
+  base = last_end + 1;
+}
+
+packed_interval_set encode_intervals(interval_set::const_iterator begin, interval_set::const_iterator end) {
+  packed_interval_set result;
+  result.data.reserve((end - begin) * 3);
+  interval_encoder out(result);
+  for (auto it = begin; it != end; ++it)
+    out.push(*it);
+  return result;
+}
+
+packed_interval_set encode_chunk(interval_set::const_iterator& it, interval_set::const_iterator end, size_t max_bytes) {
+  packed_interval_set result;
+  interval_encoder out(result);
+  while (it != end && (result.empty() || result.data.size() < max_bytes))
+    out.push(*it++);
+  return result;
+}
+
+interval_set decode_intervals(const packed_interval_set& id_set) {
+  return interval_set(id_set.begin(), id_set.end());
+}
+
+int64_t intervals_amount(const packed_interval_set& id_set) {
+  int64_t amount = 0;
+  for (const auto& range: id_set)
+    amount += interval_size(range);
+  return amount;
+}
+
+bool merge_sets(packed_interval_set& set1, interval_set::const_iterator begin, interval_set::const_iterator end) {
+  if (begin == end)
+    return false;
+
+  packed_interval_set merged;
+  merged.data.reserve(set1.data.size() + (end - begin) * 3);
+  interval_encoder out(merged);
+
+  // everything ending before the first incoming id is copied as is
+  auto it = set1.begin(), last = set1.end();
+  id_type prefix_end = 0;
+  while (it != last && it->second + 1 < begin->first) {
+    prefix_end = it->second;
+    ++it;
+  }
+  out.append_encoded(set1.data.data(), it.position(), prefix_end);
+
+  // `pending` is held back until nothing else can coalesce into it
+  id_pair pending = it != last && it->first < begin->first ? *it++ : *begin++;
+  auto emit = [&](const id_pair& range) {
+    if (pending.second + 1 >= range.first) {
+      pending.second = std::max(pending.second, range.second);
+    } else {
+      out.push(pending);
+      pending = range;
+    }
+  };
+
+  while (begin != end) {
+    if (it != last && it->first < begin->first)
+      emit(*it++);
+    else
+      emit(*begin++);
+  }
+  while (it != last && pending.second + 1 >= it->first)
+    emit(*it++);
+  out.push(pending);
+
+  // the first interval after the merged region gets a new gap, the ones
+  // following it are still relative to it and are copied as they are
+  if (it != last) {
+    out.push(*it);
+    auto rest = std::next(it).position();
+    const char* rest_end = set1.data.data() + set1.data.size();
+    merged.data.insert(merged.data.end(), rest, rest_end);
+  }
+
+  set1 = std::move(merged);
+  return true;
+}
+
+interval_set substract_amount(packed_interval_set& id_set, int64_t amount) {
+  if (id_set.empty() || amount <= 0) return {};
+
+  int64_t total = intervals_amount(id_set);
+  if (amount > total) return {};
+
+  // same cut as the interval_set version: the first total - amount ids
+  // stay, the ones after them are taken
+  int64_t keep = total - amount;
+  int64_t kept = 0;
+  id_type kept_end = 0;
+  auto it = id_set.begin(), last = id_set.end();
+  while (it != last && kept + int64_t(interval_size(*it)) <= keep) {
+    kept += interval_size(*it);
+    kept_end = it->second;
+    ++it;
+  }
+
+  packed_interval_set rest;
+  rest.data.reserve(it.position() - id_set.data.data() + 20);
+  interval_encoder out(rest);
+  out.append_encoded(id_set.data.data(), it.position(), kept_end);
+
+  interval_set result;
+  if (kept < keep) {
+    id_type split = it->first + (keep - kept) - 1;
+    out.push({it->first, split});
+    result.push_back({split + 1, it->second});
+    ++it;
+  }
+  result.insert(result.end(), it, last);
+
+  id_set = std::move(rest);
+  return result;
+}
+
+packed_points::const_iterator::const_iterator(const char* pos, const char* end)
+: start(pos), next(pos), last(end) {
+  decode();
+}
+
+packed_points::const_iterator& packed_points::const_iterator::operator++() {
+  start = next;
+  decode();
+  return *this;
+}
+
+void packed_points::const_iterator::decode() {
+  if (start == last) return;
+  point& first = current.first;
+  first.latitude = unzigzag(first.latitude, read_varint(next, last));
+  first.longitude = unzigzag(first.longitude, read_varint(next, last));
+  current.second = {first.latitude, int64_t(uint64_t(first.longitude) + read_varint(next, last))};
+}
+
+void points_encoder::push(const point& cell) {
+  if (length && cell.latitude == first.latitude && uint64_t(cell.longitude) == uint64_t(first.longitude) + length) {
+    ++length;
+    return;
+  }
+  finish();
+  first = cell;
+  length = 1;
+}
+
+void points_encoder::finish() {
+  if (!length) return;
+  write_run();
+  base = first;
+  length = 0;
+}
+
+void points_encoder::write_run() {
+  write_varint(out, zigzag(base.latitude, first.latitude));
+  write_varint(out, zigzag(base.longitude, first.longitude));
+  write_varint(out, length - 1);
+}
+
+packed_points encode_points(const std::vector<point>& cells) {
+  packed_points result;
+  points_encoder out(result);
+  for (const auto& cell: cells)
+    out.push(cell);
+  out.finish();
+  return result;
+}
+
+std::vector<point> decode_points(const packed_points& cells) {
+  std::vector<point> result;
+  for (const auto& run: cells) {
+    uint64_t length = uint64_t(run.second.longitude) - uint64_t(run.first.longitude) + 1;
+    for (uint64_t i = 0; i < length; ++i)
+      result.push_back({run.first.latitude, int64_t(uint64_t(run.first.longitude) + i)});
+  }
+  return result;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <iterator>
+#include "prange.hpp"
+
+// Compact form of an interval_set for table rows. Every interval is stored
+// as two unsigned LEB128 varints: its distance from the first id after the
+// previous interval and its length minus one. Ids are issued in contiguous blocks,
+// so most intervals take two or three bytes instead of sixteen.
+struct packed_interval_set {
+  std::vector<char> data;
+
+  // Decodes intervals one at a time, nothing is materialized.
+  class const_iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = id_pair;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const id_pair*;
+    using reference         = const id_pair&;
+
+    const_iterator() = default;
+    const_iterator(const char* pos, const char* end);
+
+    reference operator*() const { return current; }
+    pointer operator->() const { return &current; }
+    const_iterator& operator++();
+    const_iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+
+    // where the current interval starts in the encoded data
+    const char* position() const { return start; }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.start == b.start; }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.start != b.start; }
+
+  private:
+    void decode();
+
+    const char* start = nullptr;
+    const char* next = nullptr;
+    const char* last = nullptr;
+    id_type base = 0;
+    id_pair current{0, 0};
+  };
+
+  const_iterator begin() const { return {data.data(), data.data() + data.size()}; }
+  const_iterator end() const { return {data.data() + data.size(), data.data() + data.size()}; }
+  bool empty() const { return data.empty(); }
+};
+
+// Appends intervals, in order, to a packed_interval_set.
+class interval_encoder {
+public:
+  explicit interval_encoder(packed_interval_set& out) : out(out.data) {}
+
+  void push(const id_pair& range);
+  // copies intervals encoded right after the last pushed one (or from the
+  // start of a set) as they are; `last_end` is the end of the last of them
+  void append_encoded(const char* first, const char* last, id_type last_end);
+
+private:
+  std::vector<char>& out;
+  id_type base = 0;
+};
+
+packed_interval_set encode_intervals(interval_set::const_iterator begin, interval_set::const_iterator end);
+// Encodes intervals from `it` on until the encoding reaches `max_bytes` and
+// leaves `it` at the first interval not taken. Takes at least one.
+packed_interval_set encode_chunk(interval_set::const_iterator& it, interval_set::const_iterator end, size_t max_bytes);
+interval_set decode_intervals(const packed_interval_set& id_set);
+int64_t intervals_amount(const packed_interval_set& id_set);
+
+bool merge_sets(packed_interval_set& set1, interval_set::const_iterator begin, interval_set::const_iterator end);
+interval_set substract_amount(packed_interval_set& id_set, int64_t amount);
+
+// Compact form of a list of cells for action data. Consecutive cells along
+// a row make a run, and every run is three varints: the zigzag latitude and
+// longitude distance of its first cell from the first cell of the previous
+// run (from 0, 0 for the first run, the base point) and its length minus
+// one. Dense areas take three or four bytes per row instead of sixteen per
+// cell.
+struct packed_points {
+  std::vector<char> data;
+
+  // Decodes runs one at a time as one-row ranges.
+  class const_iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = points_pair;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const points_pair*;
+    using reference         = const points_pair&;
+
+    const_iterator() = default;
+    const_iterator(const char* pos, const char* end);
+
+    reference operator*() const { return current; }
+    pointer operator->() const { return &current; }
+    const_iterator& operator++();
+    const_iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.start == b.start; }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.start != b.start; }
+
+  private:
+    void decode();
+
+    const char* start = nullptr;
+    const char* next = nullptr;
+    const char* last = nullptr;
+    points_pair current{{0, 0}, {0, 0}};
+  };
+
+  const_iterator begin() const { return {data.data(), data.data() + data.size()}; }
+  const_iterator end() const { return {data.data() + data.size(), data.data() + data.size()}; }
+  bool empty() const { return data.empty(); }
+};
+
+// Appends cells, in order, to a packed_points; finish() writes the last run.
+class points_encoder {
+public:
+  explicit points_encoder(packed_points& out) : out(out.data) {}
+
+  void push(const point& cell);
+  void finish();
+
+private:
+  void write_run();
+
+  std::vector<char>& out;
+  point base{0, 0};
+  point first{0, 0};
+  uint64_t length = 0;
+};
+
+packed_points encode_points(const std::vector<point>& cells);
+std::vector<point> decode_points(const packed_points& cells);
@@ -1,4 +1,5 @@
 #include "prange.hpp"
+#include <algorithm>
 
 size_t points_range_length(const points_pair& range) {
   auto first_pair = std::minmax(range.first.latitude, range.second.latitude);
@@ -12,54 +13,167 @@ size_t points_range_length(const points_pair& range) {
   return (first + 1) * (second + 1);
 }
 
-bool merge_sets(interval_set& set1, interval_set::const_iterator begin, interval_set::const_iterator end) {
-    size_t set2_size = end - begin;
-    if (set1.empty() || !set2_size)
-      return false;
+points_pair normalize_range(const points_pair& range) {
+  auto lat = std::minmax(range.first.latitude, range.second.latitude);
+  auto lon = std::minmax(range.first.longitude, range.second.longitude);
+  return {{lat.first, lon.first}, {lat.second, lon.second}};
+}
 
-    interval_set newset;
-    newset.reserve(set1.size() + set2_size);
-    auto out = newset.begin();
+// Ranges passed to the functions below are normalized.
 
-    auto it1 = set1.begin();
-    auto it2 = begin;
-    if (it1->first < it2->first)
-        newset.push_back(*it1++);
-    else
-        newset.push_back(*it2++);
-
-    while(it1 != set1.end() && it2 != end) {
-        id_pair val = *it2;
-        if (it2->first < it1->first) {
-            ++it2;
-        } else {
-            val = *it1;
-            ++it1;
-        }
-        if (val.first == out->second + 1)
-          out->second = val.second;
-        else {
-          newset.push_back(val);
-          ++out;
-        }
+bool ranges_overlap(const points_pair& a, const points_pair& b) {
+  return a.first.latitude <= b.second.latitude && b.first.latitude <= a.second.latitude
+      && a.first.longitude <= b.second.longitude && b.first.longitude <= a.second.longitude;
+}
+
+point range_point(const points_pair& range, uint64_t offset) {
+  uint64_t width = uint64_t(range.second.longitude) - uint64_t(range.first.longitude) + 1;
+  return {int64_t(uint64_t(range.first.latitude) + offset / width),
+          int64_t(uint64_t(range.first.longitude) + offset % width)};
+}
+
+namespace {
+
+// Exponential search for the first interval in [from, last) that starts
+// after `id`. Cheap when the answer is close to `from`, which is the case
+// when a few incoming intervals are spliced into a large set.
+const id_pair* gallop_after(const id_pair* from, const id_pair* last, id_type id) {
+  const id_pair* lo = from;
+  const id_pair* hi = from;
+  size_t step = 1;
+  while (hi < last && hi->first <= id) {
+    lo = hi + 1;
+    hi = size_t(last - hi) > step ? hi + step : last;
+    step <<= 1;
+  }
+  return std::upper_bound(lo, hi, id, [](id_type a, const auto& b){
+    return a < b.first;
+  });
+}
+
+// merge_walk outputs: only counting, writing over a buffer that holds the
+// (shifted) source, or appending to a fresh vector
+struct count_out {
+  size_t w = 0;
+  size_t size() const { return w; }
+  void push(const id_pair&) { ++w; }
+  void extend(id_type) {}
+  void append(const id_pair* first, const id_pair* last) { w += last - first; }
+};
+
+struct buffer_out {
+  id_pair* data;
+  size_t w = 0;
+  size_t size() const { return w; }
+  void push(const id_pair& val) { data[w++] = val; }
+  void extend(id_type second) { data[w - 1].second = second; }
+  void append(const id_pair* first, const id_pair* last) {
+    if (data + w != first)
+      std::copy(first, last, data + w);
+    w += last - first;
+  }
+};
+
+struct vector_out {
+  interval_set& set;
+  size_t size() const { return set.size(); }
+  void push(const id_pair& val) { set.push_back(val); }
+  void extend(id_type second) { set.back().second = second; }
+  void append(const id_pair* first, const id_pair* last) { set.insert(set.end(), first, last); }
+};
+
+// Merges src[0, count) with [begin, end) into `out`. Returns how far the
+// writes got ahead of the reads, i.e. how much the source has to be moved
+// to the right before it can be merged over itself.
+template<typename Out>
+size_t merge_walk(const id_pair* src, size_t count, Out& out,
+                  interval_set::const_iterator begin, interval_set::const_iterator end) {
+  size_t i = 0, need = 0, start = out.size();
+  id_type last_end = 0;
+
+  // returns true when `val` was coalesced into the last written interval
+  auto emit = [&](const id_pair& val) {
+    if (out.size() > start && last_end + 1 >= val.first) {
+      if (val.second > last_end) {
+        last_end = val.second;
+        out.extend(last_end);
+      }
+      return true;
     }
-    if (it1 != end) {
-        if (it1->first == out->second + 1)
-            out->second = it1++->second;
-        newset.insert(newset.end(), it1, set1.end());
+    out.push(val);
+    last_end = val.second;
+    size_t w = out.size() - start;
+    if (w > i) need = std::max(need, w - i);
+    return false;
+  };
+
+  // copies src[i, last) as one block, the first interval that does not
+  // coalesce ends any chance of coalescing for the rest of the run
+  auto run = [&](size_t last) {
+    while (i < last && emit(id_pair(src[i++])));
+    if (i < last) {
+      out.append(src + i, src + last);
+      i = last;
+      last_end = src[last - 1].second;
     }
-    if (it2 != end) {
-        if (it2->first == out->second + 1)
-            out->second = it2++->second;
-        newset.insert(newset.end(), it2, end);
+  };
+
+  for (auto it = begin; it != end;) {
+    if (i < count && src[i].first < it->first)
+      run(i + 1 == count || src[i + 1].first > it->first ? i + 1 : gallop_after(src + i, src + count, it->first) - src);
+    else
+      emit(*it++);
+  }
+  run(count);
+
+  return need;
+}
+
+}
+
+bool merge_sets(interval_set& set1, interval_set::const_iterator begin, interval_set::const_iterator end) {
+  if (begin == end)
+    return false;
+
+  // everything ending before the first incoming id stays where it is
+  size_t count = set1.size();
+  size_t from = std::lower_bound(set1.begin(), set1.end(), begin->first, [](const auto& a, id_type b){
+    return a.second + 1 < b;
+  }) - set1.begin();
+  size_t tail = count - from;
+
+  // the tail never moves more than one slot per incoming interval; when
+  // that does not fit work out how much room is really needed, usually
+  // none since transferred ids tend to coalesce
+  size_t shift = end - begin;
+  if (count + shift > set1.capacity()) {
+    count_out counter;
+    shift = merge_walk(set1.data() + from, tail, counter, begin, end);
+
+    if (count + shift > set1.capacity()) {
+      // has to grow anyway, merge straight into a new buffer
+      interval_set merged;
+      merged.reserve(from + counter.size());
+      merged.assign(set1.begin(), set1.begin() + from);
+      vector_out out{merged};
+      merge_walk(set1.data() + from, tail, out, begin, end);
+      set1 = std::move(merged);
+      return true;
     }
+  }
 
-    set1 = std::move(newset);
-    return true;
+  if (shift) {
+    set1.resize(count + shift);
+    std::move_backward(set1.begin() + from, set1.begin() + count, set1.end());
+  }
+  buffer_out out{set1.data() + from};
+  merge_walk(set1.data() + from + shift, tail, out, begin, end);
+  set1.resize(from + out.size());
+  return true;
 }
 
 interval_set::iterator insert_interval(interval_set& id_set, const id_pair& range) {
-  if (range.first <= range.second)
+  if (range.first > range.second)
     return id_set.end();
 
   auto first_less = [](const auto& a, const auto& b){
@@ -85,36 +199,95 @@ interval_set::iterator insert_interval(interval_set& id_set, const id_pair& rang
 }
 
 interval_set substract_amount(interval_set& id_set, int64_t amount) {
-  if (id_set.empty()) return {};
-  interval_set result;
-  auto it = prev(id_set.end()), nend = id_set.end();
-  int64_t accumulated = 0;
-  int64_t interval_size = 0;
-  for(; accumulated < amount; --it) {
-    interval_size = it->second - it->first + 1;
-    if (accumulated + interval_size <= amount) {
-        accumulated += interval_size;
-        result.push_back(*it);
-        nend = rotate(it, next(it), nend);
-    }
-    if (it == id_set.begin())
-        break;
+  if (id_set.empty() || amount <= 0) return {};
+
+  // whole intervals are taken from the back, the first one that is larger
+  // than what is left gets split
+  auto cut = id_set.end();
+  int64_t remainder = amount;
+  while (remainder > 0 && cut != id_set.begin()) {
+    int64_t interval_size = prev(cut)->second - prev(cut)->first + 1;
+    if (interval_size > remainder)
+      break;
+    remainder -= interval_size;
+    --cut;
   }
-  if(nend == id_set.begin() && accumulated < amount)
+  if (remainder > 0 && cut == id_set.begin())
     return {};
-  // interval split
-  id_set.erase(nend, id_set.end());
-  --nend;
-  int64_t remainder = amount - accumulated;
+
+  interval_set result;
+  result.reserve(id_set.end() - cut + (remainder > 0));
   if (remainder > 0) {
-    id_type split = nend->second - remainder;
-    id_pair tail{split + 1, nend->second};
-    nend->second = split;
-    auto it = upper_bound(result.begin(), result.end(), tail.first, [](const auto& a, const auto& b){
-        return a > b.first;
-    });
-    result.insert(it, tail);
+    auto& split = *prev(cut);
+    result.push_back({split.second - remainder + 1, split.second});
+    split.second -= remainder;
   }
-  reverse(result.begin(), result.end());
+  result.insert(result.end(), cut, id_set.end());
+  id_set.erase(cut, id_set.end());
   return result;
 }
+
+bool remove_sets(interval_set& id_set, interval_set::const_iterator begin, interval_set::const_iterator end) {
+  if (begin == end) return true;
+
+  auto own = std::lower_bound(id_set.cbegin(), id_set.cend(), begin->first, [](const auto& a, id_type id){
+    return a.second < id;
+  });
+  interval_set result(id_set.cbegin(), own);
+  result.reserve(id_set.size() + (end - begin));
+
+  for (auto in = begin; in != end; ++own) {
+    while (own != id_set.cend() && own->second < in->first)
+      result.push_back(*own++);
+    if (own == id_set.cend() || own->first > in->first || own->second < in->second)
+      return false;
+
+    // cut every removed interval that lies in *own out of it
+    id_type from = own->first;
+    for (; in != end && in->second <= own->second; ++in) {
+      if (in->first < from || in->first > in->second)
+        return false;
+      if (from < in->first)
+        result.push_back({from, in->first - 1});
+      from = in->second + 1;
+    }
+    if (from <= own->second)
+      result.push_back({from, own->second});
+  }
+  result.insert(result.end(), own, id_set.cend());
+
+  id_set = std::move(result);
+  return true;
+}
+
+bool remove_id(interval_set& id_set, id_type id) {
+  auto it = std::upper_bound(id_set.begin(), id_set.end(), id, [](id_type a, const auto& b){
+    return a < b.first;
+  });
+  if (it == id_set.begin() || prev(it)->second < id)
+    return false;
+
+  auto& own = *prev(it);
+  if (own.first == own.second) {
+    id_set.erase(prev(it));
+  } else if (own.first == id) {
+    ++own.first;
+  } else if (own.second == id) {
+    --own.second;
+  } else if (id_set.size() < id_set.capacity()) {
+    id_type last = own.second;
+    own.second = id - 1;
+    id_set.insert(it, {id + 1, last});
+  } else {
+    // a full vector would be copied to a doubled buffer and then shifted,
+    // copy it once into one that just fits instead
+    interval_set split;
+    split.reserve(id_set.size() + 1);
+    split.assign(id_set.begin(), it);
+    split.back().second = id - 1;
+    split.push_back({id + 1, own.second});
+    split.insert(split.end(), it, id_set.end());
+    id_set = std::move(split);
+  }
+  return true;
+}
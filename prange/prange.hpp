@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <vector>
+#include "small_vector.hpp"
 
 typedef uint64_t id_type;
 
@@ -12,9 +15,23 @@ struct point {
 
 typedef std::pair<point,point>     points_pair;
 typedef std::pair<id_type,id_type> id_pair;
-typedef std::vector<id_pair>       interval_set;
+// Most holders own one to three intervals, those sets need no allocation.
+typedef small::vector<id_pair, 3>  interval_set;
 
 size_t points_range_length(const points_pair& range);
+
+// The cells of a range are numbered row by row from its low corner, the
+// offset of a cell is (latitude - low latitude) * width + (longitude - low
+// longitude).
+points_pair normalize_range(const points_pair& range);
+bool ranges_overlap(const points_pair& a, const points_pair& b);
+point range_point(const points_pair& range, uint64_t offset);
 bool merge_sets(interval_set& set1, interval_set::const_iterator begin, interval_set::const_iterator end);
 interval_set::iterator insert_interval(interval_set& id_set, const id_pair& range);
 interval_set substract_amount(interval_set& id_set, int64_t amount);
+// Removes the ids of the sorted, disjoint [begin, end) from id_set. Returns
+// false and leaves id_set as it was when some of them are not in it.
+bool remove_sets(interval_set& id_set, interval_set::const_iterator begin, interval_set::const_iterator end);
+// Removes the single id `id`, splitting the interval around it. One binary
+// search and at most one insert. Returns false when id is not in id_set.
+bool remove_id(interval_set& id_set, id_type id);
@@ -0,0 +1,563 @@
+// Checks the interval algorithms and interval_lookup against plain
+// std::set references, the rasterizer and morton keys against per-cell
+// ones, packed points by round trip and small::vector against std::vector,
+// all on random inputs. Exits non-zero on the first failure of every check.
+// Usage: prange_test [seed]
+
+#include "interval_lookup.hpp"
+#include "morton.hpp"
+#include "packed_set.hpp"
+#include "prange.hpp"
+#include "raster.hpp"
+
+#include <eosio/datastream.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+using id_list = std::set<id_type>;
+
+std::mt19937_64 rng;
+int failures = 0;
+
+uint64_t below(uint64_t n) { return n ? rng() % n : 0; }
+
+std::string describe(const interval_set& ids) {
+  std::string s;
+  for (const auto& range: ids)
+    s += " [" + std::to_string(range.first) + "," + std::to_string(range.second) + "]";
+  return s.empty() ? " (empty)" : s;
+}
+
+// Reports the first failure of a check, later ones only count.
+bool expect(bool ok, const char* check, size_t round, const std::string& detail = "") {
+  static std::set<std::string> reported;
+  if (!ok && reported.insert(check).second) {
+    std::printf("FAIL %s, round %zu:%s\n", check, round, detail.c_str());
+    ++failures;
+  }
+  return ok;
+}
+
+interval_set to_intervals(const id_list& ids) {
+  interval_set result;
+  for (auto id: ids) {
+    if (!result.empty() && result.back().second + 1 == id)
+      result.back().second = id;
+    else
+      result.push_back({id, id});
+  }
+  return result;
+}
+
+// Ids of [base, base + domain) taken with probability 1 / every, so the
+// sets range from single ids to long runs.
+id_list random_ids(id_type base, uint64_t domain, uint64_t every) {
+  id_list result;
+  for (uint64_t i = 0; i < domain; ++i)
+    if (below(every) == 0)
+      result.insert(base + i);
+  return result;
+}
+
+// `ids` as a sorted list of intervals, adjacent ones not always joined
+interval_set split_randomly(const id_list& ids) {
+  interval_set result;
+  for (auto id: ids) {
+    if (!result.empty() && result.back().second + 1 == id && below(3))
+      result.back().second = id;
+    else
+      result.push_back({id, id});
+  }
+  return result;
+}
+
+// Large ids test the varint widths, a large holder the galloping search.
+id_type random_base() {
+  switch (below(3)) {
+    case 0: return 0;
+    case 1: return below(1000);
+    default: return (id_type(1) << 40) + below(1 << 20);
+  }
+}
+
+void test_merge_sets() {
+  for (size_t round = 0; round < 10000; ++round) {
+    id_type base = random_base();
+    bool large = round % 10 == 0;
+    uint64_t domain = large ? 4000 : 1 + below(80);
+    id_list held = random_ids(base, domain, 1 + below(4));
+    id_list incoming;
+    for (auto id: random_ids(base, domain, large ? 200 : 1 + below(4)))
+      if (!held.count(id) || below(4) == 0)
+        incoming.insert(id);
+
+    interval_set set = to_intervals(held);
+    // in place, shifting into spare room, or into a new buffer
+    switch (below(3)) {
+      case 0: set.shrink_to_fit(); break;
+      case 1: set.reserve(set.size() + below(8)); break;
+      default: break;
+    }
+    interval_set in = split_randomly(incoming);
+
+    id_list all = held;
+    all.insert(incoming.begin(), incoming.end());
+    interval_set expected = to_intervals(all);
+
+    interval_set merged = set;
+    bool changed = merge_sets(merged, in.cbegin(), in.cend());
+    expect(changed == !in.empty(), "merge_sets result", round);
+    expect(merged == expected, "merge_sets", round, describe(set) + " +" + describe(in) + " =" + describe(merged));
+
+    packed_interval_set packed = encode_intervals(set.cbegin(), set.cend());
+    merge_sets(packed, in.cbegin(), in.cend());
+    expect(decode_intervals(packed) == expected, "packed merge_sets", round, describe(decode_intervals(packed)));
+    expect(packed.data == encode_intervals(expected.cbegin(), expected.cend()).data, "packed merge_sets encoding", round);
+  }
+}
+
+void test_substract_amount() {
+  for (size_t round = 0; round < 10000; ++round) {
+    id_list held = random_ids(random_base(), 1 + below(round % 10 == 0 ? 2000 : 60), 1 + below(4));
+    int64_t amount = int64_t(below(held.size() + 3)) - 1;
+
+    // the `amount` highest ids, nothing when there are not that many
+    id_list taken, kept = held;
+    if (amount > 0 && size_t(amount) <= held.size()) {
+      for (int64_t i = 0; i < amount; ++i) {
+        taken.insert(*kept.rbegin());
+        kept.erase(std::prev(kept.end()));
+      }
+    }
+
+    interval_set set = to_intervals(held);
+    packed_interval_set packed = encode_intervals(set.cbegin(), set.cend());
+    interval_set result = substract_amount(set, amount);
+    expect(result == to_intervals(taken), "substract_amount taken", round, describe(result));
+    expect(set == to_intervals(kept), "substract_amount kept", round, describe(set));
+
+    expect(intervals_amount(packed) == int64_t(held.size()), "intervals_amount", round);
+    result = substract_amount(packed, amount);
+    expect(result == to_intervals(taken), "packed substract_amount taken", round, describe(result));
+    expect(decode_intervals(packed) == to_intervals(kept), "packed substract_amount kept", round);
+  }
+}
+
+void test_remove() {
+  for (size_t round = 0; round < 10000; ++round) {
+    id_list held = random_ids(random_base(), 1 + below(round % 10 == 0 ? 2000 : 60), 1 + below(3));
+    id_list removed;
+    for (auto id: held)
+      if (below(3) == 0)
+        removed.insert(id);
+    // now and then one that is not held
+    bool foreign = below(5) == 0;
+    if (foreign)
+      removed.insert(held.empty() ? 7 : *held.rbegin() + 1);
+
+    interval_set set = to_intervals(held);
+    interval_set out = split_randomly(removed);
+    id_list kept;
+    for (auto id: held)
+      if (!removed.count(id))
+        kept.insert(id);
+
+    interval_set result = set;
+    bool ok = remove_sets(result, out.cbegin(), out.cend());
+    expect(ok == !foreign, "remove_sets result", round);
+    expect(result == (foreign ? set : to_intervals(kept)), "remove_sets", round, describe(set) + " -" + describe(out) + " =" + describe(result));
+
+    if (!held.empty()) {
+      id_type id = below(4) ? *std::next(held.begin(), below(held.size())) : *held.rbegin() + 1 + below(3);
+      id_list rest = held;
+      bool owned = rest.erase(id) > 0;
+      interval_set single = set;
+      if (below(2)) single.shrink_to_fit();
+      expect(remove_id(single, id) == owned, "remove_id result", round);
+      expect(single == to_intervals(rest), "remove_id", round, describe(set) + " -" + std::to_string(id) + " =" + describe(single));
+    }
+  }
+}
+
+// The definition the rasterizer follows, one cell and every edge at a time:
+// the cell is in when an odd number of edges crosses its row centre at or
+// left of its centre.
+bool inside_reference(const std::vector<point>& polygon, const point& cell) {
+  bool in = false;
+  for (size_t i = 0; i < polygon.size(); ++i) {
+    point a = polygon[i], b = polygon[(i + 1) % polygon.size()];
+    if (a.latitude > b.latitude)
+      std::swap(a, b);
+    if (cell.latitude < a.latitude || cell.latitude >= b.latitude)
+      continue;
+    __int128 dy = b.latitude - a.latitude, dx = b.longitude - a.longitude;
+    if (2 * dy * a.longitude + dx * (2 * (__int128(cell.latitude) - a.latitude) + 1) <= dy * (2 * __int128(cell.longitude) + 1))
+      in = !in;
+  }
+  return in;
+}
+
+// Random, fixed concave and self-touching shapes, shifted anywhere up to
+// MAX_RASTER_COORD. Vertices stay within `side` of the shift.
+std::vector<point> random_polygon(int64_t& side) {
+  std::vector<point> polygon;
+  switch (below(5)) {
+    case 0:
+      // L shape
+      polygon = {{0, 0}, {0, 6}, {2, 6}, {2, 2}, {7, 2}, {7, 0}};
+      side = 7;
+      break;
+    case 1:
+      // two squares touching at a corner, one ring
+      polygon = {{0, 0}, {0, 4}, {4, 4}, {4, 8}, {8, 8}, {8, 4}, {4, 4}, {4, 0}};
+      side = 8;
+      break;
+    case 2:
+      // star, its points cross each other
+      polygon = {{0, 5}, {10, 8}, {3, 0}, {3, 10}, {10, 2}};
+      side = 10;
+      break;
+    default: {
+      // sometimes more edges than SMALL_POLYGON_EDGES, for the sweep
+      side = 2 + below(14);
+      size_t n = 3 + below(below(3) ? 6 : 30);
+      for (size_t i = 0; i < n; ++i)
+        polygon.push_back({int64_t(below(side + 1)), int64_t(below(side + 1))});
+      break;
+    }
+  }
+  point shift{int64_t(below(41)) - 20, int64_t(below(41)) - 20};
+  if (below(4) == 0)
+    shift.latitude = below(2) ? MAX_RASTER_COORD - side : -MAX_RASTER_COORD;
+  if (below(4) == 0)
+    shift.longitude = below(2) ? MAX_RASTER_COORD - side : -MAX_RASTER_COORD;
+  for (auto& pt: polygon)
+    pt = {pt.latitude + shift.latitude, pt.longitude + shift.longitude};
+  return polygon;
+}
+
+void test_raster() {
+  for (size_t round = 0; round < 5000; ++round) {
+    int64_t side = 0;
+    auto polygon = random_polygon(side);
+    point low = polygon[0];
+    for (const auto& pt: polygon)
+      low = {std::min(low.latitude, pt.latitude), std::min(low.longitude, pt.longitude)};
+
+    // every cell of the bounding box and one around it, as row runs
+    std::vector<points_pair> expected;
+    uint64_t count = 0;
+    for (int64_t lat = low.latitude - 1; lat <= low.latitude + side; ++lat) {
+      for (int64_t lon = low.longitude - 1; lon <= low.longitude + side; ++lon) {
+        if (!inside_reference(polygon, {lat, lon}))
+          continue;
+        ++count;
+        if (!expected.empty() && expected.back().second.latitude == lat && expected.back().second.longitude + 1 == lon)
+          expected.back().second.longitude = lon;
+        else
+          expected.push_back({{lat, lon}, {lat, lon}});
+      }
+    }
+
+    auto spans = rasterize_polygon(polygon);
+    bool same = spans.size() == expected.size();
+    for (size_t i = 0; same && i < spans.size(); ++i)
+      same = spans[i].first.latitude == expected[i].first.latitude && spans[i].first.longitude == expected[i].first.longitude &&
+             spans[i].second.latitude == expected[i].second.latitude && spans[i].second.longitude == expected[i].second.longitude;
+    expect(same, "rasterize_polygon", round, " " + std::to_string(spans.size()) + " spans for " + std::to_string(expected.size()));
+    expect(polygon_cells(polygon) == count, "polygon_cells", round);
+
+    // single cells, runs of the polygon and runs reaching past them, alone
+    // and together in rasterizer or random order
+    std::vector<point> cells;
+    std::vector<bool> cells_in;
+    for (size_t i = 0; i < 20; ++i) {
+      point cell{low.latitude - 1 + int64_t(below(side + 2)), low.longitude - 1 + int64_t(below(side + 2))};
+      bool in = inside_reference(polygon, cell);
+      expect(cells_inside(polygon, {cell}) == in, "cells_inside", round);
+      cells.push_back(cell);
+      cells_in.push_back(in);
+    }
+    bool all_in = std::find(cells_in.begin(), cells_in.end(), false) == cells_in.end();
+    expect(cells_inside(polygon, cells) == all_in, "cells_inside batch", round);
+
+    if (expected.empty())
+      continue;
+    std::vector<points_pair> runs;
+    for (size_t i = 0; i < 10; ++i) {
+      // the runs are as long as they go, a cell past either end is out
+      points_pair run = expected[below(expected.size())];
+      bool past = below(4) == 0;
+      if (past && below(2))
+        --run.first.longitude;
+      else if (past)
+        ++run.second.longitude;
+      else
+        run.first.longitude += below(run.second.longitude - run.first.longitude + 1);
+      expect(spans_inside(polygon, {run}) == !past, "spans_inside", round);
+      runs.push_back(run);
+      if (!past && below(2))
+        std::swap(runs[below(runs.size())], runs.back());
+    }
+    bool runs_in = std::all_of(runs.begin(), runs.end(), [&](const points_pair& run){
+      for (point cell = run.first; cell.longitude <= run.second.longitude; ++cell.longitude)
+        if (!inside_reference(polygon, cell))
+          return false;
+      return true;
+    });
+    expect(spans_inside(polygon, runs) == runs_in, "spans_inside batch", round);
+    expect(spans_inside(polygon, expected), "spans_inside of the rasterizer", round);
+  }
+
+  // a few rows with edges across the whole coordinate range, too wide to
+  // go through cell by cell: every span has to be a maximal run
+  for (size_t round = 0; round < 2000; ++round) {
+    auto far = [] { return int64_t(rng() % uint64_t(2 * MAX_RASTER_COORD + 1)) - MAX_RASTER_COORD; };
+    std::vector<point> polygon;
+    for (size_t i = 0, n = 3 + below(4); i < n; ++i)
+      polygon.push_back({int64_t(below(6)), below(3) ? far() : (below(2) ? MAX_RASTER_COORD : -MAX_RASTER_COORD)});
+
+    bool maximal = true;
+    for (const auto& span: rasterize_polygon(polygon)) {
+      point before{span.first.latitude, span.first.longitude - 1}, after{span.second.latitude, span.second.longitude + 1};
+      maximal = maximal && inside_reference(polygon, span.first) && inside_reference(polygon, span.second) &&
+                !inside_reference(polygon, before) && !inside_reference(polygon, after);
+    }
+    expect(maximal, "rasterize_polygon across the range", round);
+    for (size_t i = 0; i < 20; ++i) {
+      point cell{int64_t(below(7)) - 1, far()};
+      expect(cells_inside(polygon, {cell}) == inside_reference(polygon, cell), "cells_inside across the range", round);
+    }
+  }
+}
+
+// Bits of both coordinates one at a time, latitude on the odd ones.
+zkey_type morton_reference(const point& pt) {
+  uint64_t lat = uint64_t(pt.latitude) ^ (uint64_t(1) << 63), lon = uint64_t(pt.longitude) ^ (uint64_t(1) << 63);
+  zkey_type key = 0;
+  for (int bit = 0; bit < 64; ++bit)
+    key |= zkey_type((lat >> bit) & 1) << (2 * bit + 1) | zkey_type((lon >> bit) & 1) << (2 * bit);
+  return key;
+}
+
+void test_morton() {
+  for (size_t round = 0; round < 5000; ++round) {
+    // boxes around 0, where the sign flips the top bit, and at both ends
+    point corner;
+    switch (below(3)) {
+      case 0: corner = {int64_t(below(64)) - 32, int64_t(below(64)) - 32}; break;
+      case 1: corner = {int64_t(rng()) >> 1, int64_t(rng()) >> 1}; break;
+      default:
+        corner = {below(2) ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max() - 15,
+                  below(2) ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max() - 15};
+        break;
+    }
+    points_pair range{corner, {corner.latitude + int64_t(below(16)), corner.longitude + int64_t(below(16))}};
+
+    bool keys = true;
+    std::set<zkey_type> in_box;
+    for (point pt = range.first; pt.latitude <= range.second.latitude; ++pt.latitude) {
+      for (pt.longitude = range.first.longitude; pt.longitude <= range.second.longitude; ++pt.longitude) {
+        zkey_type key = morton_key(pt);
+        point back = morton_point(key);
+        keys = keys && key == morton_reference(pt) && back.latitude == pt.latitude && back.longitude == pt.longitude;
+        in_box.insert(key);
+        if (pt.longitude == std::numeric_limits<int64_t>::max())
+          break;
+      }
+      if (pt.latitude == std::numeric_limits<int64_t>::max())
+        break;
+    }
+    expect(keys, "morton_key", round);
+
+    // with room for every interval they hold the keys of the box and no
+    // other, with fewer they still hold all of them
+    size_t max_ranges = below(2) ? 1 + below(8) : 1 << 20;
+    auto ranges = morton_ranges(range, max_ranges);
+    bool ordered = !ranges.empty() && ranges.size() <= max_ranges;
+    for (size_t i = 0; ordered && i < ranges.size(); ++i)
+      ordered = ranges[i].first <= ranges[i].second && (i == 0 || ranges[i - 1].second < ranges[i].first);
+    expect(ordered, "morton_ranges ordered", round);
+
+    bool covered = true;
+    for (auto key: in_box) {
+      auto it = std::upper_bound(ranges.begin(), ranges.end(), key, [](zkey_type k, const zkey_range& r){ return k < r.first; });
+      covered = covered && it != ranges.begin() && key <= std::prev(it)->second;
+    }
+    expect(covered, "morton_ranges cover the box", round);
+
+    if (max_ranges == 1 << 20) {
+      zkey_type held = 0;
+      for (const auto& r: ranges)
+        held += r.second - r.first + 1;
+      expect(held == in_box.size(), "morton_ranges hold only the box", round,
+             " " + std::to_string(uint64_t(held)) + " keys for " + std::to_string(in_box.size()));
+    }
+  }
+}
+
+void test_packed_points() {
+  for (size_t round = 0; round < 5000; ++round) {
+    std::vector<point> cells;
+    point pt{int64_t(below(1 << 20)) - (1 << 19), int64_t(below(1 << 20)) - (1 << 19)};
+    size_t n = below(200);
+    for (size_t i = 0; i < n; ++i) {
+      switch (below(4)) {
+        case 0: pt = {int64_t(rng()) >> (1 + below(63)), int64_t(rng()) >> (1 + below(63))}; break;
+        case 1: pt.latitude += int64_t(below(5)) - 2; break;
+        default: pt.longitude += 1; break;
+      }
+      cells.push_back(pt);
+    }
+    auto packed = encode_points(cells);
+    auto decoded = decode_points(packed);
+    bool same = decoded.size() == cells.size();
+    for (size_t i = 0; same && i < cells.size(); ++i)
+      same = decoded[i].latitude == cells[i].latitude && decoded[i].longitude == cells[i].longitude;
+    expect(same, "packed_points round trip", round);
+  }
+}
+
+void test_interval_lookup() {
+  for (size_t round = 0; round < 5000; ++round) {
+    // now and then the empty set, or one that runs up to the largest id
+    bool top = below(4) == 0;
+    uint64_t domain = round % 50 == 0 ? 0 : 1 + below(round % 10 == 0 ? 5000 : 100);
+    id_type base = top ? std::numeric_limits<id_type>::max() - (domain ? domain - 1 : 0) : random_base();
+    id_list held = random_ids(base, domain, 1 + below(4));
+    if (top && domain)
+      held.insert(std::numeric_limits<id_type>::max());
+
+    interval_set set = to_intervals(held);
+    interval_lookup lookup(set);
+    expect(lookup.size() == set.size(), "interval_lookup size", round);
+
+    // ids in, between and around the intervals, and both ends of id_type
+    std::vector<id_type> ids{0, 1, std::numeric_limits<id_type>::max(), std::numeric_limits<id_type>::max() - 1};
+    for (size_t i = 0, n = below(40); i < n; ++i)
+      ids.push_back(base + below(domain + 2) - 1);
+    for (const auto& range: set) {
+      ids.push_back(range.first);
+      ids.push_back(range.second);
+      ids.push_back(range.first - 1);
+      ids.push_back(range.second + 1);
+    }
+
+    std::unique_ptr<bool[]> found(new bool[ids.size()]);
+    lookup.contains(ids.data(), ids.size(), found.get());
+    for (size_t i = 0; i < ids.size(); ++i) {
+      bool in = held.count(ids[i]) > 0;
+      if (lookup.contains(ids[i]) != in || found[i] != in) {
+        std::string detail = describe(set) + " ? " + std::to_string(ids[i]);
+        expect(lookup.contains(ids[i]) == in, "interval_lookup contains", round, detail);
+        expect(found[i] == in, "interval_lookup batch", round, detail);
+      }
+    }
+  }
+}
+
+// Runs of random operations on both, the inline capacity is crossed both
+// ways all the time.
+void test_small_vector() {
+  using small_list = small::vector<uint32_t, 4>;
+  for (size_t round = 0; round < 2000; ++round) {
+    small_list v;
+    std::vector<uint32_t> ref;
+    for (size_t op = 0; op < 60; ++op) {
+      uint32_t value = uint32_t(rng());
+      size_t at = below(ref.size() + 1);
+      size_t n = below(7);
+      switch (below(14)) {
+        case 0: case 1: v.push_back(value); ref.push_back(value); break;
+        case 2: if (!ref.empty()) { v.pop_back(); ref.pop_back(); } break;
+        case 3: v.insert(v.begin() + at, value); ref.insert(ref.begin() + at, value); break;
+        case 4: v.insert(v.begin() + at, n, value); ref.insert(ref.begin() + at, n, value); break;
+        case 5: {
+          std::vector<uint32_t> more(n, value);
+          for (auto& x: more) x += uint32_t(below(100));
+          v.insert(v.begin() + at, more.begin(), more.end());
+          ref.insert(ref.begin() + at, more.begin(), more.end());
+          break;
+        }
+        case 6:
+          if (at < ref.size()) { v.erase(v.begin() + at); ref.erase(ref.begin() + at); }
+          break;
+        case 7: {
+          size_t last = at + below(ref.size() - at + 1);
+          v.erase(v.begin() + at, v.begin() + last);
+          ref.erase(ref.begin() + at, ref.begin() + last);
+          break;
+        }
+        case 8: v.resize(n * 2, value); ref.resize(n * 2, value); break;
+        case 9: v.reserve(below(12)); break;
+        case 10: v.shrink_to_fit(); break;
+        case 11: v.assign(n, value); ref.assign(n, value); break;
+        case 12: {
+          // copies and moves between inline and heap storage
+          small_list copy(v);
+          small_list other(ref.size() % 3 + below(8), value);
+          other = std::move(copy);
+          v.swap(other);
+          break;
+        }
+        default: if (below(8) == 0) { v.clear(); ref.clear(); } break;
+      }
+      bool same = v.size() == ref.size() && std::equal(v.begin(), v.end(), ref.begin());
+      if (!expect(same && v.capacity() >= v.size() && v.is_inline() == (v.capacity() == 4), "small::vector", round))
+        break;
+    }
+
+    // serialized like std::vector, read back to the same elements
+    auto bytes = eosio::pack(v);
+    expect(bytes == eosio::pack(ref), "small::vector pack", round);
+    expect(eosio::unpack<small_list>(bytes) == v, "small::vector unpack", round);
+  }
+
+  // long sets use a multi-byte count
+  interval_set ids = to_intervals(random_ids(1 << 30, 3000, 2));
+  std::vector<id_pair> ref(ids.begin(), ids.end());
+  expect(eosio::pack(ids) == eosio::pack(ref), "interval_set pack", 0);
+  expect(eosio::unpack<interval_set>(eosio::pack(ref)) == ids, "interval_set unpack", 0);
+
+  // counts past the stream or past 32 bits are refused before anything
+  // is allocated
+  for (std::vector<char> bytes: {std::vector<char>{char(0x85), 0x01, 0, 0, 0, 0},
+                                 std::vector<char>{char(0xff), char(0xff), char(0xff), char(0xff), 0x1f}}) {
+    bool refused = false;
+    try {
+      eosio::unpack<small::vector<uint8_t, 4>>(bytes);
+    } catch (const eosio::eosio_assert_exception&) {
+      refused = true;
+    }
+    expect(refused, "small::vector size out of range", 0);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+  rng.seed(seed);
+
+  test_merge_sets();
+  test_substract_amount();
+  test_remove();
+  test_raster();
+  test_morton();
+  test_packed_points();
+  test_interval_lookup();
+  test_small_vector();
+
+  std::printf("%s (seed %lu)\n", failures ? "FAILED" : "passed", seed);
+  return failures ? 1 : 0;
+}
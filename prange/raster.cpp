@@ -0,0 +1,211 @@
+#include "raster.hpp"
+#include <algorithm>
+
+namespace {
+
+// first column whose centre is at or right of the crossing num / (2 * dy)
+int64_t first_column(__int128 num, int64_t dy) {
+  __int128 n = num - dy, d = __int128(2) * dy;
+  // 128-bit division is a library call, most crossings do without it
+  if (n == int64_t(n) && d == int64_t(d)) {
+    int64_t q = int64_t(n) / int64_t(d);
+    return q + (int64_t(n) % int64_t(d) != 0 && n > 0);
+  }
+  __int128 q = n / d;
+  if (n % d != 0 && n > 0)
+    ++q;
+  return int64_t(q);
+}
+
+}
+
+std::vector<raster_edge> raster_edges(const std::vector<point>& polygon) {
+  // horizontal edges never cross a row centre
+  std::vector<raster_edge> edges;
+  for (size_t i = 0; i < polygon.size(); ++i) {
+    point a = polygon[i], b = polygon[(i + 1) % polygon.size()];
+    if (a.latitude == b.latitude)
+      continue;
+    if (a.latitude > b.latitude)
+      std::swap(a, b);
+
+    int64_t dy = b.latitude - a.latitude, dx = b.longitude - a.longitude;
+    edges.push_back({a.latitude, b.latitude, __int128(2) * dy * a.longitude + dx, dx, dy});
+  }
+  std::sort(edges.begin(), edges.end(), [](const raster_edge& a, const raster_edge& b){
+    return a.low < b.low;
+  });
+  return edges;
+}
+
+scanline_rasterizer::scanline_rasterizer(const std::vector<point>& polygon)
+: edges(raster_edges(polygon)) {}
+
+bool scanline_rasterizer::next_row() {
+  for (;;) {
+    if (started) {
+      ++row;
+      active.erase(std::remove_if(active.begin(), active.end(), [&](const raster_edge& e){ return e.high <= row; }), active.end());
+      for (auto& e: active)
+        e.num += __int128(2) * e.dx;
+    }
+    if (active.empty()) {
+      // skip the rows between separate parts of the polygon
+      if (pending == edges.size())
+        return false;
+      row = started ? std::max(row, edges[pending].low) : edges[pending].low;
+    }
+    started = true;
+    while (pending < edges.size() && edges[pending].low == row)
+      active.push_back(edges[pending++]);
+
+    // a row centre never passes through a vertex, so the crossings pair up
+    bounds.clear();
+    for (const auto& e: active)
+      bounds.push_back(first_column(e.num, e.dy));
+    std::sort(bounds.begin(), bounds.end());
+    span = 0;
+    if (!bounds.empty())
+      return true;
+  }
+}
+
+bool scanline_rasterizer::next(points_pair& out) {
+  for (;;) {
+    while (span + 1 < bounds.size()) {
+      int64_t first = bounds[span], last = bounds[span + 1] - 1;
+      span += 2;
+      // spans meeting at a crossing pair are one run of cells
+      while (span + 1 < bounds.size() && bounds[span] == last + 1) {
+        last = std::max(last, bounds[span + 1] - 1);
+        span += 2;
+      }
+      if (first <= last) {
+        out = {{row, first}, {row, last}};
+        return true;
+      }
+    }
+    if (!next_row())
+      return false;
+  }
+}
+
+std::vector<points_pair> rasterize_polygon(const std::vector<point>& polygon) {
+  std::vector<points_pair> spans;
+  scanline_rasterizer raster(polygon);
+  points_pair span;
+  while (raster.next(span))
+    spans.push_back(span);
+  return spans;
+}
+
+uint64_t polygon_cells(const std::vector<point>& polygon) {
+  uint64_t cells = 0;
+  scanline_rasterizer raster(polygon);
+  points_pair span;
+  while (raster.next(span))
+    cells += uint64_t(span.second.longitude - span.first.longitude) + 1;
+  return cells;
+}
+
+namespace {
+
+// whether `e` crosses the centre line of the cell's row at or left of it
+bool crossed_left(const raster_edge& e, const point& cell) {
+  if (cell.latitude < e.low || cell.latitude >= e.high)
+    return false;
+  return (__int128(2) * cell.longitude + 1) * e.dy >= e.num + __int128(2) * e.dx * (cell.latitude - e.low);
+}
+
+int64_t row_bound(const raster_edge& e, int64_t row) {
+  return first_column(e.num + __int128(2) * e.dx * (row - e.low), e.dy);
+}
+
+// A cell is inside when an odd number of the row's sorted bounds is at or
+// left of it. `left` is that number for a cell at or before the span and
+// is moved up to its first cell.
+bool span_covered(const std::vector<int64_t>& bounds, size_t& left, const points_pair& span) {
+  while (left < bounds.size() && bounds[left] <= span.first.longitude)
+    ++left;
+  if (left % 2 == 0)
+    return false;
+  // crossings at the same column cancel out
+  for (size_t i = left; i < bounds.size() && bounds[i] <= span.second.longitude;) {
+    size_t same = i;
+    while (i < bounds.size() && bounds[i] == bounds[same])
+      ++i;
+    if (i % 2 == 0)
+      return false;
+  }
+  return true;
+}
+
+bool sweep_inside(const std::vector<raster_edge>& edges, const std::vector<points_pair>& sorted) {
+  size_t pending = 0;
+  std::vector<raster_edge> active;
+  std::vector<int64_t> bounds;
+  for (auto it = sorted.begin(); it != sorted.end();) {
+    int64_t row = it->first.latitude;
+    while (pending < edges.size() && edges[pending].low <= row)
+      active.push_back(edges[pending++]);
+    active.erase(std::remove_if(active.begin(), active.end(), [&](const raster_edge& e){ return e.high <= row; }), active.end());
+
+    bounds.clear();
+    for (const auto& e: active)
+      bounds.push_back(row_bound(e, row));
+    std::sort(bounds.begin(), bounds.end());
+
+    size_t left = 0;
+    for (; it != sorted.end() && it->first.latitude == row; ++it)
+      if (!span_covered(bounds, left, *it))
+        return false;
+  }
+  return true;
+}
+
+}
+
+bool spans_inside(const std::vector<point>& polygon, const std::vector<points_pair>& spans) {
+  auto edges = raster_edges(polygon);
+
+  // a few edges are quicker to go through for every span than to sort the
+  // spans for
+  if (edges.size() <= SMALL_POLYGON_EDGES) {
+    std::vector<int64_t> bounds;
+    return std::all_of(spans.begin(), spans.end(), [&](const points_pair& span){
+      if (span.first.longitude == span.second.longitude) {
+        size_t crossed = 0;
+        for (const auto& e: edges)
+          crossed += crossed_left(e, span.first);
+        return crossed % 2 == 1;
+      }
+      int64_t row = span.first.latitude;
+      bounds.clear();
+      for (const auto& e: edges)
+        if (e.low <= row && row < e.high)
+          bounds.push_back(row_bound(e, row));
+      std::sort(bounds.begin(), bounds.end());
+      size_t left = 0;
+      return span_covered(bounds, left, span);
+    });
+  }
+
+  auto row_major = [](const points_pair& a, const points_pair& b){
+    return a.first.latitude < b.first.latitude || (a.first.latitude == b.first.latitude && a.first.longitude < b.first.longitude);
+  };
+  // spans planned or generated by the rasterizer come in order already
+  if (std::is_sorted(spans.begin(), spans.end(), row_major))
+    return sweep_inside(edges, spans);
+
+  std::vector<points_pair> sorted(spans);
+  std::sort(sorted.begin(), sorted.end(), row_major);
+  return sweep_inside(edges, sorted);
+}
+
+bool cells_inside(const std::vector<point>& polygon, const std::vector<point>& cells) {
+  std::vector<points_pair> spans;
+  spans.reserve(cells.size());
+  for (const auto& cell: cells)
+    spans.push_back({cell, cell});
+  return spans_inside(polygon, spans);
+}
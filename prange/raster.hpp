@@ -0,0 +1,56 @@
+#pragma once
+
+#include "prange.hpp"
+
+// A polygon edge that crosses row centres: its crossing with the centre
+// line of row `row` lies at num / (2 * dy) longitude, num growing by
+// 2 * dx per row from `low`.
+struct raster_edge {
+  int64_t  low;        // first row it crosses
+  int64_t  high;       // first row it does not
+  __int128 num;
+  int64_t  dx;
+  int64_t  dy;
+};
+
+// Edges of `polygon` ordered by low.
+std::vector<raster_edge> raster_edges(const std::vector<point>& polygon);
+
+// Scanline fill of a polygon over the cell grid. Cell (lat, lon) is the unit
+// square from that corner and belongs to the polygon when its centre lies
+// inside by the even-odd rule. Only integer arithmetic is used, so every
+// node gets the same cells.
+//
+// Cells come out as spans of one row, {{lat, first lon}, {lat, last lon}},
+// ordered by latitude, then longitude. Every coordinate must be within
+// MAX_RASTER_COORD.
+class scanline_rasterizer {
+public:
+  explicit scanline_rasterizer(const std::vector<point>& polygon);
+
+  // next span, false once all are out
+  bool next(points_pair& span);
+
+private:
+  bool next_row();
+
+  std::vector<raster_edge> edges;
+  size_t pending = 0;        // edges[pending, end) are not active yet
+  std::vector<raster_edge> active;
+  bool started = false;
+  int64_t row = 0;
+  std::vector<int64_t> bounds;
+  size_t span = 0;
+};
+
+constexpr int64_t MAX_RASTER_COORD = int64_t(1) << 60;
+
+std::vector<points_pair> rasterize_polygon(const std::vector<point>& polygon);
+uint64_t polygon_cells(const std::vector<point>& polygon);
+// Whether every cell of the one-row `spans` is a cell of the polygon, the
+// same ones the rasterizer gives. Unless the polygon has at most
+// SMALL_POLYGON_EDGES edges, the spans are swept row by row, so each row
+// costs its active edges once instead of every span costing every edge.
+constexpr size_t SMALL_POLYGON_EDGES = 16;
+bool spans_inside(const std::vector<point>& polygon, const std::vector<points_pair>& spans);
+bool cells_inside(const std::vector<point>& polygon, const std::vector<point>& cells);
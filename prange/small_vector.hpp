@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <eosio/check.hpp>
+
+namespace small {
+
+// std::vector for trivially copyable elements that keeps up to N of them in
+// the object itself and only goes to the heap beyond that. Serialized like
+// std::vector: a varuint32 count followed by the elements.
+//
+// The template is called vector on purpose, the abi generator describes
+// every specialization of a template named vector as an array of its first
+// argument.
+template<typename T, size_t N>
+class vector {
+  static_assert(N > 0, "inline capacity must not be empty");
+  static_assert(std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>,
+                "elements are copied around as plain memory");
+
+public:
+  using value_type             = T;
+  using size_type              = size_t;
+  using difference_type        = std::ptrdiff_t;
+  using reference              = T&;
+  using const_reference        = const T&;
+  using pointer                = T*;
+  using const_pointer          = const T*;
+  using iterator               = T*;
+  using const_iterator         = const T*;
+  using reverse_iterator       = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  vector() noexcept {}
+  explicit vector(size_type n) { resize(n); }
+  vector(size_type n, const T& value) { assign(n, value); }
+  template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+  vector(It first, It last) { assign(first, last); }
+  vector(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+  vector(const vector& other) { assign(other.begin(), other.end()); }
+  vector(vector&& other) noexcept { take(other); }
+  ~vector() { release(); }
+
+  vector& operator=(const vector& other) {
+    if (this != &other)
+      assign(other.begin(), other.end());
+    return *this;
+  }
+
+  vector& operator=(vector&& other) noexcept {
+    if (this != &other) {
+      release();
+      take(other);
+    }
+    return *this;
+  }
+
+  vector& operator=(std::initializer_list<T> init) {
+    assign(init.begin(), init.end());
+    return *this;
+  }
+
+  iterator begin() noexcept { return items; }
+  const_iterator begin() const noexcept { return items; }
+  const_iterator cbegin() const noexcept { return items; }
+  iterator end() noexcept { return items + count; }
+  const_iterator end() const noexcept { return items + count; }
+  const_iterator cend() const noexcept { return items + count; }
+  reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+  const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+  reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+  const_reverse_iterator crend() const noexcept { return rend(); }
+
+  size_type size() const noexcept { return count; }
+  size_type capacity() const noexcept { return room; }
+  bool empty() const noexcept { return count == 0; }
+  // whether the elements are still in the object itself
+  bool is_inline() const noexcept { return items == inline_items(); }
+
+  T* data() noexcept { return items; }
+  const T* data() const noexcept { return items; }
+  T& operator[](size_type i) { return items[i]; }
+  const T& operator[](size_type i) const { return items[i]; }
+  T& front() { return items[0]; }
+  const T& front() const { return items[0]; }
+  T& back() { return items[count - 1]; }
+  const T& back() const { return items[count - 1]; }
+
+  void reserve(size_type n) {
+    if (n > room)
+      reallocate(n);
+  }
+
+  // moves the elements back inline when they fit
+  void shrink_to_fit() {
+    if (!is_inline() && count < room)
+      reallocate(count);
+  }
+
+  void clear() noexcept { count = 0; }
+
+  void push_back(const T& value) {
+    if (count == room) {
+      T copy = value;       // value may live in the buffer about to be freed
+      grow(count + 1);
+      new (items + count) T(copy);
+    } else {
+      new (items + count) T(value);
+    }
+    ++count;
+  }
+
+  template<typename... Args>
+  T& emplace_back(Args&&... args) {
+    T value(std::forward<Args>(args)...);
+    push_back(value);
+    return back();
+  }
+
+  void pop_back() { --count; }
+
+  void resize(size_type n) { resize(n, T()); }
+
+  void resize(size_type n, const T& value) {
+    if (n > count) {
+      T copy = value;
+      reserve(n);
+      std::uninitialized_fill(items + count, items + n, copy);
+    }
+    count = n;
+  }
+
+  template<typename It>
+  void assign(It first, It last) {
+    clear();
+    insert(end(), first, last);
+  }
+
+  void assign(size_type n, const T& value) {
+    clear();
+    resize(n, value);
+  }
+
+  void assign(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+
+  iterator insert(const_iterator pos, const T& value) {
+    T copy = value;
+    size_type at = pos - items;
+    open(at, 1);
+    new (items + at) T(copy);
+    return items + at;
+  }
+
+  template<typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    return insert(pos, T(std::forward<Args>(args)...));
+  }
+
+  iterator insert(const_iterator pos, size_type n, const T& value) {
+    T copy = value;
+    size_type at = pos - items;
+    open(at, n);
+    std::uninitialized_fill(items + at, items + at + n, copy);
+    return items + at;
+  }
+
+  iterator insert(const_iterator pos, std::initializer_list<T> init) {
+    return insert(pos, init.begin(), init.end());
+  }
+
+  template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+  iterator insert(const_iterator pos, It first, It last) {
+    size_type at = pos - items;
+    using category = typename std::iterator_traits<It>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+      size_type n = std::distance(first, last);
+      open(at, n);
+      std::uninitialized_copy(first, last, items + at);
+    } else if (at == count) {
+      for (; first != last; ++first)
+        push_back(*first);
+    } else {
+      vector pending(first, last);
+      insert(pos, pending.begin(), pending.end());
+    }
+    return items + at;
+  }
+
+  iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    iterator from = items + (first - items);
+    if (first != last) {
+      std::copy(last, cend(), from);
+      count -= last - first;
+    }
+    return from;
+  }
+
+  void swap(vector& other) noexcept {
+    vector tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  friend bool operator==(const vector& a, const vector& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+  }
+  friend bool operator!=(const vector& a, const vector& b) { return !(a == b); }
+  friend bool operator<(const vector& a, const vector& b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+  }
+
+private:
+  T* inline_items() noexcept { return reinterpret_cast<T*>(storage); }
+  const T* inline_items() const noexcept { return reinterpret_cast<const T*>(storage); }
+
+  void release() noexcept {
+    if (!is_inline())
+      ::operator delete(items);
+  }
+
+  // steals the heap buffer of `other`, or copies its inline elements
+  void take(vector& other) noexcept {
+    if (other.is_inline()) {
+      items = inline_items();
+      room = N;
+      std::uninitialized_copy(other.begin(), other.end(), items);
+    } else {
+      items = other.items;
+      room = other.room;
+      other.items = other.inline_items();
+      other.room = N;
+    }
+    count = other.count;
+    other.count = 0;
+  }
+
+  void reallocate(size_type n) {
+    T* fresh = n <= N ? inline_items() : static_cast<T*>(::operator new(n * sizeof(T)));
+    if (fresh == items)
+      return;
+    std::uninitialized_copy(begin(), end(), fresh);
+    release();
+    items = fresh;
+    room = n <= N ? N : n;
+  }
+
+  void grow(size_type needed) {
+    reallocate(std::max<size_type>(needed, 2 * room));
+  }
+
+  // makes room for n uninitialized elements at `at`, moving the tail once
+  void open(size_type at, size_type n) {
+    if (n == 0)
+      return;
+    if (count + n > room) {
+      size_type fresh_room = std::max<size_type>(count + n, 2 * room);
+      T* fresh = static_cast<T*>(::operator new(fresh_room * sizeof(T)));
+      std::uninitialized_copy(begin(), begin() + at, fresh);
+      std::uninitialized_copy(begin() + at, end(), fresh + at + n);
+      release();
+      items = fresh;
+      room = fresh_room;
+    } else if (count - at > n) {
+      // the last n go past the end, the rest shifts over itself
+      std::uninitialized_copy(end() - n, end(), end());
+      std::copy_backward(items + at, end() - n, end());
+    } else {
+      std::uninitialized_copy(items + at, end(), items + at + n);
+    }
+    count += n;
+  }
+
+  T* items = inline_items();
+  uint32_t count = 0;
+  uint32_t room = N;
+  alignas(T) unsigned char storage[N * sizeof(T)];
+};
+
+template<typename T, size_t N>
+void swap(vector<T, N>& a, vector<T, N>& b) noexcept { a.swap(b); }
+
+template<typename Stream, typename T, size_t N>
+Stream& operator<<(Stream& ds, const vector<T, N>& v) {
+  uint64_t left = v.size();
+  do {
+    char byte = char((left & 0x7f) | (left > 0x7f ? 0x80 : 0));
+    ds.write(&byte, 1);
+    left >>= 7;
+  } while (left);
+  for (const auto& item: v)
+    ds << item;
+  return ds;
+}
+
+template<typename Stream, typename T, size_t N>
+Stream& operator>>(Stream& ds, vector<T, N>& v) {
+  uint64_t size = 0;
+  char byte = 0;
+  int shift = 0;
+  do {
+    ds.read(&byte, 1);
+    size |= uint64_t(uint8_t(byte) & 0x7f) << shift;
+    shift += 7;
+  } while ((byte & 0x80) && shift < 35);
+  // a count the stream cannot hold means it is corrupt, every element
+  // takes a byte at least
+  eosio::check(size <= UINT32_MAX && size <= ds.remaining(), "vector size out of range");
+  v.resize(size);
+  for (auto& item: v)
+    ds >> item;
+  return ds;
+}
+
+}
@@ -0,0 +1,409 @@
+#include <sim/chain.hpp>
+#include <sim/db.hpp>
+
+#include <eosio/print.hpp>
+#include <eosio/system.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <set>
+#include <unordered_map>
+
+namespace sim {
+
+namespace {
+
+using table_key = std::tuple<uint64_t, uint64_t, uint64_t>;
+
+struct row {
+  std::vector<char> data;
+  name payer;
+};
+
+struct secondary_index {
+  std::set<db::secondary_entry> entries;
+  std::unordered_map<uint64_t, uint128_t> by_primary;
+};
+
+struct table {
+  std::map<uint64_t, row> rows;
+  std::map<uint32_t, secondary_index> indices;
+};
+
+// One undo record per database change, replayed backwards on failure.
+struct undo_entry {
+  table_key key;
+  uint64_t pk;
+  std::optional<uint32_t> index;
+  std::optional<row> old_row;
+  std::optional<uint128_t> old_key;
+};
+
+struct action_context {
+  const eosio::action* act;
+  name receiver;
+  std::vector<name> notified;
+  std::vector<std::pair<eosio::action, name>> inlines;
+};
+
+struct state {
+  std::set<uint64_t> accounts;
+  std::map<uint64_t, apply_handler> contracts;
+  std::map<table_key, table> tables;
+  std::vector<undo_entry> undo;
+  std::vector<action_context*> stack;
+  counters stats;
+  std::string console;
+  eosio::time_point now{eosio::microseconds(int64_t(1577836800) * 1000000)};
+};
+
+state& st() {
+  static state s;
+  return s;
+}
+
+table_key key_of(const db::table_ref& t) { return {t.code, t.scope, t.table}; }
+
+table* find_table(const db::table_ref& t) {
+  auto it = st().tables.find(key_of(t));
+  return it == st().tables.end() ? nullptr : &it->second;
+}
+
+table& get_table(const db::table_ref& t) { return st().tables[key_of(t)]; }
+
+secondary_index* find_index(const db::table_ref& t, uint32_t index) {
+  auto tab = find_table(t);
+  if (!tab) return nullptr;
+  auto it = tab->indices.find(index);
+  return it == tab->indices.end() ? nullptr : &it->second;
+}
+
+action_context& context() {
+  eosio::check(!st().stack.empty(), "no action is executing");
+  return *st().stack.back();
+}
+
+void execute(const eosio::action& act, name sender);
+
+void apply(action_context& ctx) {
+  auto contract = st().contracts.find(ctx.receiver.value);
+  if (contract != st().contracts.end())
+    contract->second(ctx.receiver, ctx.act->account, ctx.act->name, ctx.act->data);
+}
+
+// Runs one action: the receiver first, then every notified account, then
+// the inline actions they sent, depth first, like nodeos does.
+void execute(const eosio::action& act, name sender) {
+  eosio::check(st().accounts.count(act.account.value), "action's account does not exist: " + act.account.to_string());
+  for (const auto& auth: act.authorization) {
+    eosio::check(st().accounts.count(auth.actor.value), "authorizing actor does not exist");
+    if (sender.value)
+      eosio::check(auth.actor == sender, "inline action is not authorized by its sender");
+  }
+
+  action_context ctx{&act, act.account, {act.account}, {}};
+  st().stats.actions++;
+
+  for (size_t i = 0; i < ctx.notified.size(); ++i) {
+    ctx.receiver = ctx.notified[i];
+    st().stack.push_back(&ctx);
+    try {
+      apply(ctx);
+    } catch (...) {
+      st().stack.pop_back();
+      throw;
+    }
+    st().stack.pop_back();
+  }
+
+  auto inlines = std::move(ctx.inlines);
+  for (const auto& inl: inlines)
+    execute(inl.first, inl.second);
+}
+
+void rollback(size_t mark) {
+  auto& undo = st().undo;
+  while (undo.size() > mark) {
+    auto entry = std::move(undo.back());
+    undo.pop_back();
+    auto& tab = st().tables[entry.key];
+    if (entry.index) {
+      auto& idx = tab.indices[*entry.index];
+      auto cur = idx.by_primary.find(entry.pk);
+      if (cur != idx.by_primary.end()) {
+        idx.entries.erase({cur->second, entry.pk});
+        idx.by_primary.erase(cur);
+      }
+      if (entry.old_key) {
+        idx.entries.insert({*entry.old_key, entry.pk});
+        idx.by_primary[entry.pk] = *entry.old_key;
+      }
+    } else if (entry.old_row) {
+      tab.rows[entry.pk] = std::move(*entry.old_row);
+    } else {
+      tab.rows.erase(entry.pk);
+    }
+  }
+}
+
+void check_write_access(const db::table_ref& t) {
+  eosio::check(context().receiver.value == t.code, "db access violation");
+}
+
+}
+
+void create_account(name account) {
+  st().accounts.insert(account.value);
+}
+
+void set_contract(name account, apply_handler handler) {
+  create_account(account);
+  st().contracts[account.value] = std::move(handler);
+}
+
+void push_transaction(const std::vector<eosio::action>& actions) {
+  eosio::check(st().stack.empty(), "cannot push a transaction from within an action");
+  size_t mark = st().undo.size();
+  try {
+    for (const auto& act: actions)
+      execute(act, name());
+  } catch (...) {
+    rollback(mark);
+    st().stack.clear();
+    throw;
+  }
+  st().undo.clear();
+}
+
+void set_time(eosio::time_point now) { st().now = now; }
+
+void produce_block(uint32_t seconds) {
+  st().now = eosio::time_point(st().now.time_since_epoch() + eosio::seconds(seconds));
+}
+
+const counters& get_counters() { return st().stats; }
+void reset_counters() { st().stats = counters{}; }
+
+std::string take_console() {
+  std::string result;
+  std::swap(result, st().console);
+  return result;
+}
+
+namespace db {
+
+const std::vector<char>* get(const table_ref& t, uint64_t pk) {
+  auto tab = find_table(t);
+  if (!tab) return nullptr;
+  auto it = tab->rows.find(pk);
+  if (it == tab->rows.end()) return nullptr;
+  st().stats.rows_read++;
+  st().stats.bytes_read += it->second.data.size();
+  return &it->second.data;
+}
+
+void store(const table_ref& t, name payer, uint64_t pk, std::vector<char> data) {
+  check_write_access(t);
+  auto& tab = get_table(t);
+  eosio::check(!tab.rows.count(pk), "db_store_i64: duplicate primary key");
+  st().undo.push_back({key_of(t), pk, std::nullopt, std::nullopt, std::nullopt});
+  st().stats.rows_written++;
+  st().stats.bytes_written += data.size();
+  tab.rows[pk] = row{std::move(data), payer};
+}
+
+void update(const table_ref& t, name payer, uint64_t pk, std::vector<char> data) {
+  check_write_access(t);
+  auto& tab = get_table(t);
+  auto it = tab.rows.find(pk);
+  eosio::check(it != tab.rows.end(), "db_update_i64: row does not exist");
+  st().undo.push_back({key_of(t), pk, std::nullopt, it->second, std::nullopt});
+  st().stats.rows_written++;
+  st().stats.bytes_written += data.size();
+  it->second = row{std::move(data), payer.value ? payer : it->second.payer};
+}
+
+void remove(const table_ref& t, uint64_t pk) {
+  check_write_access(t);
+  auto& tab = get_table(t);
+  auto it = tab.rows.find(pk);
+  eosio::check(it != tab.rows.end(), "db_remove_i64: row does not exist");
+  st().undo.push_back({key_of(t), pk, std::nullopt, std::move(it->second), std::nullopt});
+  st().stats.rows_erased++;
+  tab.rows.erase(it);
+}
+
+std::optional<uint64_t> first(const table_ref& t) {
+  auto tab = find_table(t);
+  if (!tab || tab->rows.empty()) return std::nullopt;
+  return tab->rows.begin()->first;
+}
+
+std::optional<uint64_t> last(const table_ref& t) {
+  auto tab = find_table(t);
+  if (!tab || tab->rows.empty()) return std::nullopt;
+  return tab->rows.rbegin()->first;
+}
+
+std::optional<uint64_t> next(const table_ref& t, uint64_t pk) {
+  auto tab = find_table(t);
+  if (!tab) return std::nullopt;
+  auto it = tab->rows.upper_bound(pk);
+  if (it == tab->rows.end()) return std::nullopt;
+  return it->first;
+}
+
+std::optional<uint64_t> prev(const table_ref& t, uint64_t pk) {
+  auto tab = find_table(t);
+  if (!tab) return std::nullopt;
+  auto it = tab->rows.lower_bound(pk);
+  if (it == tab->rows.begin()) return std::nullopt;
+  return std::prev(it)->first;
+}
+
+std::optional<uint64_t> lower_bound(const table_ref& t, uint64_t pk) {
+  auto tab = find_table(t);
+  if (!tab) return std::nullopt;
+  auto it = tab->rows.lower_bound(pk);
+  if (it == tab->rows.end()) return std::nullopt;
+  return it->first;
+}
+
+std::optional<uint64_t> upper_bound(const table_ref& t, uint64_t pk) {
+  return next(t, pk);
+}
+
+void idx_store(const table_ref& t, uint32_t index, uint64_t pk, uint128_t key) {
+  check_write_access(t);
+  auto& idx = get_table(t).indices[index];
+  st().undo.push_back({key_of(t), pk, index, std::nullopt, std::nullopt});
+  st().stats.index_writes++;
+  idx.entries.insert({key, pk});
+  idx.by_primary[pk] = key;
+}
+
+void idx_update(const table_ref& t, uint32_t index, uint64_t pk, uint128_t key) {
+  check_write_access(t);
+  auto& idx = get_table(t).indices[index];
+  auto cur = idx.by_primary.find(pk);
+  eosio::check(cur != idx.by_primary.end(), "db_idx_update: secondary entry does not exist");
+  st().undo.push_back({key_of(t), pk, index, std::nullopt, cur->second});
+  st().stats.index_writes++;
+  idx.entries.erase({cur->second, pk});
+  idx.entries.insert({key, pk});
+  cur->second = key;
+}
+
+void idx_remove(const table_ref& t, uint32_t index, uint64_t pk) {
+  check_write_access(t);
+  auto& idx = get_table(t).indices[index];
+  auto cur = idx.by_primary.find(pk);
+  eosio::check(cur != idx.by_primary.end(), "db_idx_remove: secondary entry does not exist");
+  st().undo.push_back({key_of(t), pk, index, std::nullopt, cur->second});
+  st().stats.index_writes++;
+  idx.entries.erase({cur->second, pk});
+  idx.by_primary.erase(cur);
+}
+
+std::optional<secondary_entry> idx_first(const table_ref& t, uint32_t index) {
+  auto idx = find_index(t, index);
+  if (!idx || idx->entries.empty()) return std::nullopt;
+  return *idx->entries.begin();
+}
+
+std::optional<secondary_entry> idx_last(const table_ref& t, uint32_t index) {
+  auto idx = find_index(t, index);
+  if (!idx || idx->entries.empty()) return std::nullopt;
+  return *idx->entries.rbegin();
+}
+
+std::optional<secondary_entry> idx_next(const table_ref& t, uint32_t index, const secondary_entry& at) {
+  auto idx = find_index(t, index);
+  if (!idx) return std::nullopt;
+  auto it = idx->entries.upper_bound(at);
+  if (it == idx->entries.end()) return std::nullopt;
+  return *it;
+}
+
+std::optional<secondary_entry> idx_prev(const table_ref& t, uint32_t index, const secondary_entry& at) {
+  auto idx = find_index(t, index);
+  if (!idx) return std::nullopt;
+  auto it = idx->entries.lower_bound(at);
+  if (it == idx->entries.begin()) return std::nullopt;
+  return *std::prev(it);
+}
+
+std::optional<secondary_entry> idx_lower_bound(const table_ref& t, uint32_t index, uint128_t key) {
+  auto idx = find_index(t, index);
+  if (!idx) return std::nullopt;
+  auto it = idx->entries.lower_bound({key, 0});
+  if (it == idx->entries.end()) return std::nullopt;
+  return *it;
+}
+
+std::optional<secondary_entry> idx_upper_bound(const table_ref& t, uint32_t index, uint128_t key) {
+  auto idx = find_index(t, index);
+  if (!idx) return std::nullopt;
+  auto it = idx->entries.upper_bound({key, UINT64_MAX});
+  if (it == idx->entries.end()) return std::nullopt;
+  return *it;
+}
+
+std::optional<secondary_entry> idx_find_primary(const table_ref& t, uint32_t index, uint64_t pk) {
+  auto idx = find_index(t, index);
+  if (!idx) return std::nullopt;
+  auto it = idx->by_primary.find(pk);
+  if (it == idx->by_primary.end()) return std::nullopt;
+  return secondary_entry{it->second, pk};
+}
+
+}
+
+}
+
+namespace eosio {
+
+void require_auth(name n) {
+  check(has_auth(n), "missing authority of " + n.to_string());
+}
+
+bool has_auth(name n) {
+  const auto& auths = sim::context().act->authorization;
+  return std::any_of(auths.begin(), auths.end(), [&](const auto& a){ return a.actor == n; });
+}
+
+bool is_account(name n) {
+  return sim::st().accounts.count(n.value) > 0;
+}
+
+void require_recipient(name notify_account) {
+  auto& notified = sim::context().notified;
+  if (std::find(notified.begin(), notified.end(), notify_account) == notified.end())
+    notified.push_back(notify_account);
+}
+
+name current_receiver() {
+  return sim::context().receiver;
+}
+
+time_point current_time_point() {
+  return sim::st().now;
+}
+
+uint32_t current_block_number() {
+  return uint32_t(sim::st().now.time_since_epoch().count() / 500000);
+}
+
+void send_inline(const action& act) {
+  auto& ctx = sim::context();
+  ctx.inlines.emplace_back(act, ctx.receiver);
+}
+
+namespace internal_use_do_not_use {
+void prints_l(const char* str, size_t len) {
+  sim::st().console.append(str, len);
+}
+}
+
+}
@@ -0,0 +1,53 @@
+#include "contracts.hpp"
+
+#include <ertc.hpp>
+#include <ertc.nft.hpp>
+
+namespace sim {
+
+void deploy_nft(name account) {
+  using ertc::nft;
+  set_contract(account, dispatcher<nft>()
+    .action("create"_n, &nft::create)
+    .action("issue"_n, &nft::issue)
+    .action("issuepacked"_n, &nft::issuepacked)
+    .action("issuerect"_n, &nft::issuerect)
+    .action("filltiles"_n, &nft::filltiles)
+    .action("reindex"_n, &nft::reindex)
+    .action("tokensinbox"_n, &nft::tokensinbox)
+    .action("issuelog"_n, &nft::issuelog)
+    .action("tokensbyval"_n, &nft::tokensbyval)
+    .action("ownerof"_n, &nft::ownerof)
+    .action("indexowners"_n, &nft::indexowners)
+    .action("transferid"_n, &nft::transferid)
+    .action("transferids"_n, &nft::transferids)
+    .action("transferbatch"_n, &nft::transferbatch)
+    .action("retire"_n, &nft::retire)
+    .action("transfer"_n, &nft::transfer)
+    .action("open"_n, &nft::open)
+    .action("migrate"_n, &nft::migrate)
+    .action("migratetoken"_n, &nft::migratetoken));
+}
+
+void deploy_ertc(name account) {
+  using ertc::ertc;
+  set_contract(account, dispatcher<ertc>()
+    .action("create"_n, &ertc::create)
+    .action("change"_n, &ertc::change)
+    .action("approve"_n, &ertc::approve)
+    .action("preissue"_n, &ertc::preissue)
+    .action("issue"_n, &ertc::issue)
+    .action("issuepacked"_n, &ertc::issuepacked)
+    .action("issuerect"_n, &ertc::issuerect)
+    .action("plancells"_n, &ertc::plancells)
+    .action("planpolygon"_n, &ertc::planpolygon)
+    .action("issuestep"_n, &ertc::issuestep)
+    .action("payout"_n, &ertc::payout)
+    .action("newshare"_n, &ertc::newshare)
+    .action("cancel"_n, &ertc::cancel)
+    .action("gcvalidation"_n, &ertc::gcvalidation)
+    .action("migrate"_n, &ertc::migrate)
+    .notify(name(), "issuelog"_n, &ertc::onissue));
+}
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <sim/chain.hpp>
+
+// Deploys the host builds of the contracts on the simulated chain, with the
+// dispatch eosio.cdt would generate for them.
+namespace sim {
+
+void deploy_nft(name account);
+void deploy_ertc(name account);
+
+}
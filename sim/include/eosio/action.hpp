@@ -0,0 +1,53 @@
+#pragma once
+
+#include <eosio/datastream.hpp>
+#include <eosio/name.hpp>
+#include <eosio/system.hpp>
+
+#include <vector>
+
+namespace eosio {
+
+struct permission_level {
+  permission_level(name a, name p) : actor(a), permission(p) {}
+  permission_level() {}
+
+  name actor;
+  name permission;
+
+  friend bool operator==(const permission_level& a, const permission_level& b) {
+    return a.actor == b.actor && a.permission == b.permission;
+  }
+
+  template<typename DataStream>
+  friend DataStream& operator<<(DataStream& ds, const permission_level& p) { return ds << p.actor << p.permission; }
+  template<typename DataStream>
+  friend DataStream& operator>>(DataStream& ds, permission_level& p) { return ds >> p.actor >> p.permission; }
+};
+
+struct action;
+void send_inline(const action& act);
+
+struct action {
+  eosio::name account;
+  eosio::name name;
+  std::vector<permission_level> authorization;
+  std::vector<char> data;
+
+  action() = default;
+
+  template<typename T>
+  action(const permission_level& auth, eosio::name a, eosio::name n, T&& value)
+  : account(a), name(n), authorization(1, auth), data(pack(std::forward<T>(value))) {}
+
+  template<typename T>
+  action(std::vector<permission_level> auths, eosio::name a, eosio::name n, T&& value)
+  : account(a), name(n), authorization(std::move(auths)), data(pack(std::forward<T>(value))) {}
+
+  void send() const { send_inline(*this); }
+
+  template<typename T>
+  T data_as() const { return unpack<T>(data); }
+};
+
+}
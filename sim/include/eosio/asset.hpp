@@ -0,0 +1,70 @@
+#pragma once
+
+#include <eosio/symbol.hpp>
+
+#include <string>
+
+namespace eosio {
+
+struct asset {
+  int64_t amount = 0;
+  eosio::symbol symbol;
+
+  static constexpr int64_t max_amount = (1LL << 62) - 1;
+
+  asset() {}
+  asset(int64_t a, eosio::symbol s) : amount(a), symbol{s} {
+    check(is_amount_within_range(), "magnitude of asset amount must be less than 2^62");
+    check(symbol.is_valid(), "invalid symbol name");
+  }
+
+  bool is_amount_within_range() const { return -max_amount <= amount && amount <= max_amount; }
+  bool is_valid() const { return is_amount_within_range() && symbol.is_valid(); }
+
+  void set_amount(int64_t a) {
+    amount = a;
+    check(is_amount_within_range(), "magnitude of asset amount must be less than 2^62");
+  }
+
+  asset operator-() const { asset r = *this; r.amount = -r.amount; return r; }
+
+  asset& operator-=(const asset& a) {
+    check(a.symbol == symbol, "attempt to subtract asset with different symbol");
+    amount -= a.amount;
+    check(-max_amount <= amount, "subtraction underflow");
+    check(amount <= max_amount, "subtraction overflow");
+    return *this;
+  }
+
+  asset& operator+=(const asset& a) {
+    check(a.symbol == symbol, "attempt to add asset with different symbol");
+    amount += a.amount;
+    check(-max_amount <= amount, "addition underflow");
+    check(amount <= max_amount, "addition overflow");
+    return *this;
+  }
+
+  friend asset operator+(const asset& a, const asset& b) { asset r = a; r += b; return r; }
+  friend asset operator-(const asset& a, const asset& b) { asset r = a; r -= b; return r; }
+
+  friend bool operator==(const asset& a, const asset& b) {
+    check(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+    return a.amount == b.amount;
+  }
+  friend bool operator!=(const asset& a, const asset& b) { return !(a == b); }
+  friend bool operator<(const asset& a, const asset& b) {
+    check(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+    return a.amount < b.amount;
+  }
+
+  std::string to_string() const {
+    return std::to_string(amount) + " " + symbol.code().to_string();
+  }
+
+  template<typename DataStream>
+  friend DataStream& operator<<(DataStream& ds, const asset& a) { return ds << a.amount << a.symbol; }
+  template<typename DataStream>
+  friend DataStream& operator>>(DataStream& ds, asset& a) { return ds >> a.amount >> a.symbol; }
+};
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <eosio/check.hpp>
+
+#include <optional>
+#include <utility>
+
+namespace eosio {
+
+// Optional trailing field: absent in rows and actions written before the
+// field was added, serialized only when set.
+template<typename T>
+class binary_extension {
+public:
+  using value_type = T;
+
+  constexpr binary_extension() {}
+  constexpr binary_extension(const T& ext) : _val(ext) {}
+  constexpr binary_extension(T&& ext) : _val(std::move(ext)) {}
+
+  constexpr bool has_value() const { return _val.has_value(); }
+
+  constexpr T& value() & {
+    check(has_value(), "cannot get value of empty binary_extension");
+    return *_val;
+  }
+  constexpr const T& value() const& {
+    check(has_value(), "cannot get value of empty binary_extension");
+    return *_val;
+  }
+
+  template<typename U>
+  constexpr T value_or(U&& def) const { return _val ? *_val : static_cast<T>(std::forward<U>(def)); }
+  constexpr T value_or() const { return _val ? *_val : T{}; }
+
+  constexpr T* operator->() { return &value(); }
+  constexpr const T* operator->() const { return &value(); }
+  constexpr T& operator*() & { return value(); }
+  constexpr const T& operator*() const& { return value(); }
+
+  template<typename... Args>
+  T& emplace(Args&&... args) & { return _val.emplace(std::forward<Args>(args)...); }
+
+  void reset() { _val.reset(); }
+
+private:
+  std::optional<T> _val;
+};
+
+template<typename DataStream, typename T>
+DataStream& operator<<(DataStream& ds, const binary_extension<T>& be) {
+  if (be.has_value())
+    ds << be.value();
+  return ds;
+}
+
+template<typename DataStream, typename T>
+DataStream& operator>>(DataStream& ds, binary_extension<T>& be) {
+  if (ds.remaining()) {
+    T val;
+    ds >> val;
+    be.emplace(std::move(val));
+  }
+  return ds;
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace eosio {
+
+// Raised by check() on the host. The simulated chain aborts the enclosing
+// transaction and rolls back every database change it made.
+struct eosio_assert_exception : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+inline void check(bool pred, const char* msg) {
+  if (!pred)
+    throw eosio_assert_exception(msg);
+}
+
+inline void check(bool pred, const std::string& msg) {
+  if (!pred)
+    throw eosio_assert_exception(msg);
+}
+
+inline void check(bool pred, std::string&& msg) {
+  if (!pred)
+    throw eosio_assert_exception(msg);
+}
+
+}
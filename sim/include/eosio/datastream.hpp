@@ -0,0 +1,331 @@
+#pragma once
+
+#include <eosio/check.hpp>
+
+#include <eosio/reflect.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+
+namespace eosio {
+
+template<typename T>
+class datastream {
+public:
+  datastream(T start, size_t s) : _start(start), _pos(start), _end(start + s) {}
+
+  inline void skip(size_t s) { _pos += s; }
+
+  inline bool read(char* d, size_t s) {
+    check(size_t(_end - _pos) >= s, "datastream attempted to read past the end");
+    std::memcpy(d, _pos, s);
+    _pos += s;
+    return true;
+  }
+
+  inline bool write(const char* d, size_t s) {
+    check(_end - _pos >= (int32_t)s, "datastream attempted to write past the end");
+    std::memcpy((void*)_pos, d, s);
+    _pos += s;
+    return true;
+  }
+
+  inline bool write(char d) { return write(&d, 1); }
+
+  inline bool get(unsigned char& c) { return get(*(char*)&c); }
+  inline bool get(char& c) {
+    check(_pos < _end, "get");
+    c = *_pos;
+    ++_pos;
+    return true;
+  }
+
+  T pos() const { return _pos; }
+  inline bool valid() const { return _pos <= _end && _pos >= _start; }
+  inline bool seekp(size_t p) { _pos = _start + p; return _pos <= _end; }
+  inline size_t tellp() const { return size_t(_pos - _start); }
+  inline size_t remaining() const { return _end - _pos; }
+
+private:
+  T _start;
+  T _pos;
+  T _end;
+};
+
+// Size-only stream used by pack_size.
+template<>
+class datastream<size_t> {
+public:
+  constexpr datastream(size_t init_size = 0) : _size(init_size) {}
+  constexpr inline bool skip(size_t s) { _size += s; return true; }
+  constexpr inline bool write(const char*, size_t s) { _size += s; return true; }
+  constexpr inline bool write(char) { _size++; return true; }
+  constexpr inline bool valid() const { return true; }
+  constexpr inline bool seekp(size_t p) { _size = p; return true; }
+  constexpr inline size_t tellp() const { return _size; }
+  constexpr inline size_t remaining() const { return 0; }
+private:
+  size_t _size;
+};
+
+struct unsigned_int {
+  unsigned_int(uint32_t v = 0) : value(v) {}
+  template<typename T>
+  unsigned_int(T v) : value(v) {}
+  operator uint32_t() const { return value; }
+  uint32_t value;
+};
+
+template<typename DataStream>
+DataStream& operator<<(DataStream& ds, const unsigned_int& v) {
+  uint64_t val = v.value;
+  do {
+    uint8_t b = uint8_t(val) & 0x7f;
+    val >>= 7;
+    b |= ((val > 0) << 7);
+    ds.write((char)b);
+  } while (val);
+  return ds;
+}
+
+template<typename DataStream>
+DataStream& operator>>(DataStream& ds, unsigned_int& vi) {
+  uint64_t v = 0;
+  char b = 0;
+  uint8_t by = 0;
+  do {
+    ds.get(b);
+    v |= uint32_t(uint8_t(b) & 0x7f) << by;
+    by += 7;
+  } while (uint8_t(b) & 0x80);
+  vi.value = static_cast<uint32_t>(v);
+  return ds;
+}
+
+// arithmetic types
+template<typename DataStream, typename T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, uint128_t> || std::is_same_v<T, int128_t>, int> = 0>
+DataStream& operator<<(DataStream& ds, const T& v) {
+  ds.write(reinterpret_cast<const char*>(&v), sizeof(T));
+  return ds;
+}
+
+template<typename DataStream, typename T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, uint128_t> || std::is_same_v<T, int128_t>, int> = 0>
+DataStream& operator>>(DataStream& ds, T& v) {
+  ds.read(reinterpret_cast<char*>(&v), sizeof(T));
+  return ds;
+}
+
+template<typename DataStream>
+DataStream& operator<<(DataStream& ds, const bool& v) {
+  return ds << uint8_t(v);
+}
+
+template<typename DataStream>
+DataStream& operator>>(DataStream& ds, bool& v) {
+  uint8_t t;
+  ds >> t;
+  v = t;
+  return ds;
+}
+
+// enums are packed as their underlying type
+template<typename DataStream, typename T, std::enable_if_t<std::is_enum_v<T>, int> = 0>
+DataStream& operator<<(DataStream& ds, const T& v) {
+  return ds << static_cast<std::underlying_type_t<T>>(v);
+}
+
+template<typename DataStream, typename T, std::enable_if_t<std::is_enum_v<T>, int> = 0>
+DataStream& operator>>(DataStream& ds, T& v) {
+  std::underlying_type_t<T> raw;
+  ds >> raw;
+  v = static_cast<T>(raw);
+  return ds;
+}
+
+template<typename DataStream>
+DataStream& operator<<(DataStream& ds, const std::string& v) {
+  ds << unsigned_int(v.size());
+  if (v.size())
+    ds.write(v.data(), v.size());
+  return ds;
+}
+
+template<typename DataStream>
+DataStream& operator>>(DataStream& ds, std::string& v) {
+  unsigned_int s;
+  ds >> s;
+  v.resize(s.value);
+  if (s.value)
+    ds.read(v.data(), v.size());
+  return ds;
+}
+
+template<typename DataStream, typename T>
+DataStream& operator<<(DataStream& ds, const std::vector<T>& v) {
+  ds << unsigned_int(v.size());
+  if constexpr (std::is_same_v<T, char> || std::is_same_v<T, unsigned char>) {
+    if (v.size())
+      ds.write((const char*)v.data(), v.size());
+  } else {
+    for (const auto& i: v)
+      ds << i;
+  }
+  return ds;
+}
+
+template<typename DataStream, typename T>
+DataStream& operator>>(DataStream& ds, std::vector<T>& v) {
+  unsigned_int s;
+  ds >> s;
+  if constexpr (std::is_same_v<T, char> || std::is_same_v<T, unsigned char>) {
+    v.resize(s.value);
+    if (s.value)
+      ds.read((char*)v.data(), v.size());
+  } else {
+    v.resize(s.value);
+    for (auto& i: v)
+      ds >> i;
+  }
+  return ds;
+}
+
+template<typename DataStream, typename T, size_t N>
+DataStream& operator<<(DataStream& ds, const std::array<T, N>& v) {
+  for (const auto& i: v)
+    ds << i;
+  return ds;
+}
+
+template<typename DataStream, typename T, size_t N>
+DataStream& operator>>(DataStream& ds, std::array<T, N>& v) {
+  for (auto& i: v)
+    ds >> i;
+  return ds;
+}
+
+template<typename DataStream, typename T1, typename T2>
+DataStream& operator<<(DataStream& ds, const std::pair<T1, T2>& t) {
+  ds << t.first;
+  ds << t.second;
+  return ds;
+}
+
+template<typename DataStream, typename T1, typename T2>
+DataStream& operator>>(DataStream& ds, std::pair<T1, T2>& t) {
+  ds >> t.first;
+  ds >> t.second;
+  return ds;
+}
+
+template<typename DataStream, typename T>
+DataStream& operator<<(DataStream& ds, const std::optional<T>& opt) {
+  char valid = opt.has_value();
+  ds << valid;
+  if (valid)
+    ds << *opt;
+  return ds;
+}
+
+template<typename DataStream, typename T>
+DataStream& operator>>(DataStream& ds, std::optional<T>& opt) {
+  char valid = 0;
+  ds >> valid;
+  if (valid) {
+    T val;
+    ds >> val;
+    opt = val;
+  } else {
+    opt.reset();
+  }
+  return ds;
+}
+
+template<typename DataStream, typename K, typename V>
+DataStream& operator<<(DataStream& ds, const std::map<K, V>& m) {
+  ds << unsigned_int(m.size());
+  for (const auto& i: m)
+    ds << i.first << i.second;
+  return ds;
+}
+
+template<typename DataStream, typename K, typename V>
+DataStream& operator>>(DataStream& ds, std::map<K, V>& m) {
+  m.clear();
+  unsigned_int s;
+  ds >> s;
+  for (uint32_t i = 0; i < s.value; ++i) {
+    K k;
+    V v;
+    ds >> k >> v;
+    m.emplace(std::move(k), std::move(v));
+  }
+  return ds;
+}
+
+template<typename DataStream, typename... Args>
+DataStream& operator<<(DataStream& ds, const std::tuple<Args...>& t) {
+  std::apply([&](const auto&... args){ (ds << ... << args); }, t);
+  return ds;
+}
+
+template<typename DataStream, typename... Args>
+DataStream& operator>>(DataStream& ds, std::tuple<Args...>& t) {
+  // a comma fold, an empty tuple would leave a bare `ds;` otherwise
+  std::apply([&](auto&... args){ ((ds >> args), ...); }, t);
+  return ds;
+}
+
+// plain aggregates, the host counterpart of the cdt generated serializers
+template<typename DataStream, typename T, std::enable_if_t<reflect::is_reflectable<T>, int> = 0>
+DataStream& operator<<(DataStream& ds, const T& v) {
+  reflect::apply(v, [&](const auto&... fields){ (ds << ... << fields); });
+  return ds;
+}
+
+template<typename DataStream, typename T, std::enable_if_t<reflect::is_reflectable<T>, int> = 0>
+DataStream& operator>>(DataStream& ds, T& v) {
+  reflect::apply(v, [&](auto&... fields){ (ds >> ... >> fields); });
+  return ds;
+}
+
+template<typename T>
+size_t pack_size(const T& value) {
+  datastream<size_t> ps;
+  ps << value;
+  return ps.tellp();
+}
+
+template<typename T>
+std::vector<char> pack(const T& value) {
+  std::vector<char> result;
+  result.resize(pack_size(value));
+  datastream<char*> ds(result.data(), result.size());
+  ds << value;
+  return result;
+}
+
+template<typename T>
+T unpack(const char* buffer, size_t len) {
+  T result;
+  datastream<const char*> ds(buffer, len);
+  ds >> result;
+  return result;
+}
+
+template<typename T>
+T unpack(const std::vector<char>& bytes) {
+  return unpack<T>(bytes.data(), bytes.size());
+}
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Host stand-in for the eosio.cdt umbrella header, see sim/README.md.
+#include <eosio/action.hpp>
+#include <eosio/check.hpp>
+#include <eosio/contract.hpp>
+#include <eosio/datastream.hpp>
+#include <eosio/multi_index.hpp>
+#include <eosio/name.hpp>
+#include <eosio/print.hpp>
+#include <eosio/system.hpp>
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <eosio/check.hpp>
+#include <eosio/datastream.hpp>
+#include <eosio/name.hpp>
+#include <eosio/system.hpp>
+#include <sim/db.hpp>
+
+#include <array>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace eosio {
+
+// modify() keeps the current payer of the row
+constexpr name same_payer{};
+
+template<class Class, typename Type, Type (Class::*PtrToMemberFunction)() const>
+struct const_mem_fun {
+  typedef typename std::remove_reference<Type>::type result_type;
+
+  Type operator()(const Class& x) const { return (x.*PtrToMemberFunction)(); }
+};
+
+template<name::raw IndexName, typename Extractor>
+struct indexed_by {
+  static constexpr name::raw index_name = IndexName;
+  typedef Extractor secondary_extractor_type;
+};
+
+// Host stand-in for eosio::multi_index on top of sim::db. Mirrors the cdt
+// interface and its caching: objects loaded through one instance stay
+// valid (and are reused) for the lifetime of that instance.
+template<name::raw TableName, typename T, typename... Indices>
+class multi_index {
+  using db_ref = sim::db::table_ref;
+
+  template<size_t I>
+  using index_def = std::tuple_element_t<I, std::tuple<Indices...>>;
+
+  template<size_t I>
+  using secondary_key_t = std::decay_t<decltype(typename index_def<I>::secondary_extractor_type()(std::declval<const T&>()))>;
+
+  template<name::raw IndexName, size_t I = 0>
+  static constexpr size_t index_position() {
+    static_assert(I < sizeof...(Indices), "name provided is not the name of any secondary index within multi_index");
+    if constexpr (index_def<I>::index_name == IndexName)
+      return I;
+    else
+      return index_position<IndexName, I + 1>();
+  }
+
+  template<size_t I>
+  static uint128_t secondary_key(const T& obj) {
+    return static_cast<uint128_t>(typename index_def<I>::secondary_extractor_type()(obj));
+  }
+
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = const T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_iterator() = default;
+
+    const T& operator*() const {
+      check(_pk.has_value(), "cannot dereference end iterator");
+      return _mi->load(*_pk);
+    }
+    const T* operator->() const { return &operator*(); }
+
+    const_iterator& operator++() {
+      check(_pk.has_value(), "cannot increment end iterator");
+      _pk = sim::db::next(_mi->ref(), *_pk);
+      return *this;
+    }
+    const_iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+
+    const_iterator& operator--() {
+      auto prev = _pk ? sim::db::prev(_mi->ref(), *_pk) : sim::db::last(_mi->ref());
+      check(prev.has_value(), "cannot decrement iterator at beginning of table");
+      _pk = prev;
+      return *this;
+    }
+    const_iterator operator--(int) { auto copy = *this; --*this; return copy; }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) { return a._pk == b._pk; }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) { return !(a == b); }
+
+  private:
+    friend class multi_index;
+    const_iterator(const multi_index* mi, std::optional<uint64_t> pk) : _mi(mi), _pk(pk) {}
+
+    const multi_index* _mi = nullptr;
+    std::optional<uint64_t> _pk;
+  };
+
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  template<size_t I>
+  class index {
+  public:
+    using secondary_key_type = secondary_key_t<I>;
+
+    class const_iterator {
+    public:
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = const T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const T*;
+      using reference = const T&;
+
+      const_iterator() = default;
+
+      const T& operator*() const {
+        check(!_end, "cannot dereference end iterator");
+        return _idx->_mi->load(_pos.second);
+      }
+      const T* operator->() const { return &operator*(); }
+
+      const_iterator& operator++() {
+        check(!_end, "cannot increment end iterator");
+        set(sim::db::idx_next(_idx->_mi->ref(), I, _pos));
+        return *this;
+      }
+      const_iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+
+      const_iterator& operator--() {
+        auto prev = _end ? sim::db::idx_last(_idx->_mi->ref(), I) : sim::db::idx_prev(_idx->_mi->ref(), I, _pos);
+        check(prev.has_value(), "cannot decrement iterator at beginning of index");
+        set(prev);
+        return *this;
+      }
+      const_iterator operator--(int) { auto copy = *this; --*this; return copy; }
+
+      friend bool operator==(const const_iterator& a, const const_iterator& b) {
+        return a._end == b._end && (a._end || a._pos == b._pos);
+      }
+      friend bool operator!=(const const_iterator& a, const const_iterator& b) { return !(a == b); }
+
+    private:
+      friend class index;
+      const_iterator(const index* idx, std::optional<sim::db::secondary_entry> pos) : _idx(idx) { set(pos); }
+
+      void set(const std::optional<sim::db::secondary_entry>& pos) {
+        _end = !pos;
+        _pos = pos.value_or(sim::db::secondary_entry{});
+      }
+
+      // a plain pair and flag, copies of an optional one trip gcc's
+      // maybe-uninitialized in std::prev
+      const index* _idx = nullptr;
+      sim::db::secondary_entry _pos{};
+      bool _end = true;
+    };
+
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    const_iterator cbegin() const { return {this, sim::db::idx_first(_mi->ref(), I)}; }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator cend() const { return {this, std::nullopt}; }
+    const_iterator end() const { return cend(); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(cend()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(cbegin()); }
+
+    const_iterator lower_bound(const secondary_key_type& key) const {
+      return {this, sim::db::idx_lower_bound(_mi->ref(), I, static_cast<uint128_t>(key))};
+    }
+    const_iterator upper_bound(const secondary_key_type& key) const {
+      return {this, sim::db::idx_upper_bound(_mi->ref(), I, static_cast<uint128_t>(key))};
+    }
+
+    const_iterator find(const secondary_key_type& key) const {
+      auto it = lower_bound(key);
+      if (it != end() && it._pos.first != static_cast<uint128_t>(key))
+        return end();
+      return it;
+    }
+
+    const_iterator require_find(const secondary_key_type& key, const char* error_msg = "unable to find secondary key") const {
+      auto it = find(key);
+      check(it != end(), error_msg);
+      return it;
+    }
+
+    const T& get(const secondary_key_type& key, const char* error_msg = "unable to find secondary key") const {
+      return *require_find(key, error_msg);
+    }
+
+    const_iterator iterator_to(const T& obj) const {
+      auto pos = sim::db::idx_find_primary(_mi->ref(), I, obj.primary_key());
+      check(pos.has_value(), "object passed to iterator_to is not in multi_index");
+      return {this, pos};
+    }
+
+    template<typename Lambda>
+    void modify(const_iterator itr, name payer, Lambda&& updater) {
+      check(itr != end(), "cannot pass end iterator to modify");
+      _mi->modify(*itr, payer, std::forward<Lambda>(updater));
+    }
+
+    const_iterator erase(const_iterator itr) {
+      check(itr != end(), "cannot pass end iterator to erase");
+      const auto& obj = *itr;
+      ++itr;
+      _mi->erase(obj);
+      return itr;
+    }
+
+    name get_code() const { return _mi->get_code(); }
+    uint64_t get_scope() const { return _mi->get_scope(); }
+
+  private:
+    friend class multi_index;
+    explicit index(multi_index* mi) : _mi(mi) {}
+
+    multi_index* _mi;
+  };
+
+  multi_index(name code, uint64_t scope) : _code(code), _scope(scope) {}
+
+  multi_index(const multi_index&) = delete;
+  multi_index& operator=(const multi_index&) = delete;
+
+  name get_code() const { return _code; }
+  uint64_t get_scope() const { return _scope; }
+
+  const_iterator cbegin() const { return {this, sim::db::first(ref())}; }
+  const_iterator begin() const { return cbegin(); }
+  const_iterator cend() const { return {this, std::nullopt}; }
+  const_iterator end() const { return cend(); }
+  const_reverse_iterator crbegin() const { return const_reverse_iterator(cend()); }
+  const_reverse_iterator rbegin() const { return crbegin(); }
+  const_reverse_iterator crend() const { return const_reverse_iterator(cbegin()); }
+  const_reverse_iterator rend() const { return crend(); }
+
+  const_iterator lower_bound(uint64_t primary) const { return {this, sim::db::lower_bound(ref(), primary)}; }
+  const_iterator upper_bound(uint64_t primary) const { return {this, sim::db::upper_bound(ref(), primary)}; }
+
+  uint64_t available_primary_key() const {
+    if (!_next_primary_key) {
+      auto last = sim::db::last(ref());
+      _next_primary_key = last ? *last + 1 : 0;
+    }
+    check(*_next_primary_key < no_available_primary_key, "next primary key in table is at autoincrement limit");
+    return *_next_primary_key;
+  }
+
+  template<name::raw IndexName>
+  auto get_index() {
+    return index<index_position<IndexName>()>(this);
+  }
+
+  template<name::raw IndexName>
+  auto get_index() const {
+    return index<index_position<IndexName>()>(const_cast<multi_index*>(this));
+  }
+
+  const_iterator iterator_to(const T& obj) const {
+    return {this, obj.primary_key()};
+  }
+
+  template<typename Lambda>
+  const_iterator emplace(name payer, Lambda&& constructor) {
+    check(_code == current_receiver(), "cannot create objects in table of another contract");
+
+    auto obj = std::make_unique<T>();
+    constructor(*obj);
+    uint64_t pk = obj->primary_key();
+    check(sim::db::get(ref(), pk) == nullptr, "could not insert object, most likely a uniqueness constraint was violated");
+
+    sim::db::store(ref(), payer, pk, pack(*obj));
+    store_secondaries(*obj, std::make_index_sequence<sizeof...(Indices)>{});
+
+    if (!_next_primary_key || pk >= *_next_primary_key)
+      _next_primary_key = pk >= no_available_primary_key ? no_available_primary_key : pk + 1;
+
+    _cache[pk] = std::move(obj);
+    return {this, pk};
+  }
+
+  template<typename Lambda>
+  void modify(const_iterator itr, name payer, Lambda&& updater) {
+    check(itr != end(), "cannot pass end iterator to modify");
+    modify(*itr, payer, std::forward<Lambda>(updater));
+  }
+
+  template<typename Lambda>
+  void modify(const T& obj, name payer, Lambda&& updater) {
+    check(_code == current_receiver(), "cannot modify objects in table of another contract");
+
+    auto& mutable_obj = const_cast<T&>(obj);
+    uint64_t pk = obj.primary_key();
+    auto keys = secondary_keys(obj, std::make_index_sequence<sizeof...(Indices)>{});
+
+    updater(mutable_obj);
+    check(pk == mutable_obj.primary_key(), "updater cannot change primary key when modifying an object");
+
+    sim::db::update(ref(), payer, pk, pack(mutable_obj));
+    update_secondaries(mutable_obj, keys, std::make_index_sequence<sizeof...(Indices)>{});
+  }
+
+  const T& get(uint64_t primary, const char* error_msg = "unable to find key") const {
+    auto result = find(primary);
+    check(result != cend(), error_msg);
+    return *result;
+  }
+
+  const_iterator find(uint64_t primary) const {
+    if (_cache.count(primary))
+      return {this, primary};
+    if (!sim::db::get(ref(), primary))
+      return end();
+    return {this, primary};
+  }
+
+  const_iterator require_find(uint64_t primary, const char* error_msg = "unable to find key") const {
+    auto it = find(primary);
+    check(it != end(), error_msg);
+    return it;
+  }
+
+  const_iterator erase(const_iterator itr) {
+    check(itr != end(), "cannot pass end iterator to erase");
+    const auto& obj = *itr;
+    ++itr;
+    erase(obj);
+    return itr;
+  }
+
+  void erase(const T& obj) {
+    check(_code == current_receiver(), "cannot erase objects in table of another contract");
+    uint64_t pk = obj.primary_key();
+    remove_secondaries(pk, std::make_index_sequence<sizeof...(Indices)>{});
+    sim::db::remove(ref(), pk);
+    _cache.erase(pk);
+  }
+
+private:
+  static constexpr uint64_t no_available_primary_key = static_cast<uint64_t>(-2);
+
+  db_ref ref() const { return {_code.value, _scope, static_cast<uint64_t>(TableName)}; }
+
+  const T& load(uint64_t pk) const {
+    auto cached = _cache.find(pk);
+    if (cached != _cache.end())
+      return *cached->second;
+
+    auto bytes = sim::db::get(ref(), pk);
+    check(bytes != nullptr, "unable to find key");
+    auto obj = std::make_unique<T>();
+    datastream<const char*> ds(bytes->data(), bytes->size());
+    ds >> *obj;
+    auto& result = *obj;
+    _cache[pk] = std::move(obj);
+    return result;
+  }
+
+  template<size_t... I>
+  void store_secondaries(const T& obj, std::index_sequence<I...>) {
+    (sim::db::idx_store(ref(), I, obj.primary_key(), secondary_key<I>(obj)), ...);
+  }
+
+  template<size_t... I>
+  auto secondary_keys(const T& obj, std::index_sequence<I...>) {
+    return std::array<uint128_t, sizeof...(I)>{secondary_key<I>(obj)...};
+  }
+
+  template<typename Keys, size_t... I>
+  void update_secondaries(const T& obj, const Keys& before, std::index_sequence<I...>) {
+    ((before[I] != secondary_key<I>(obj) ? sim::db::idx_update(ref(), I, obj.primary_key(), secondary_key<I>(obj)) : void()), ...);
+  }
+
+  template<size_t... I>
+  void remove_secondaries([[maybe_unused]] uint64_t pk, std::index_sequence<I...>) {
+    (sim::db::idx_remove(ref(), I, pk), ...);
+  }
+
+  name _code;
+  uint64_t _scope;
+  mutable std::optional<uint64_t> _next_primary_key;
+  mutable std::map<uint64_t, std::unique_ptr<T>> _cache;
+};
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <eosio/name.hpp>
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace eosio {
+
+namespace internal_use_do_not_use {
+void prints_l(const char* str, size_t len);
+}
+
+inline void printl(const char* ptr, size_t len) { internal_use_do_not_use::prints_l(ptr, len); }
+inline void print(const char* ptr) { printl(ptr, std::char_traits<char>::length(ptr)); }
+inline void print(const std::string& s) { printl(s.data(), s.size()); }
+inline void print(char c) { printl(&c, 1); }
+inline void print(bool b) { print(b ? "true" : "false"); }
+inline void print(name n) { print(n.to_string()); }
+
+template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>, int> = 0>
+inline void print(T num) { print(std::to_string(num)); }
+
+template<typename T, std::enable_if_t<std::is_floating_point_v<T>, int> = 0>
+inline void print(T num) { print(std::to_string(num)); }
+
+inline void printhex(const void* data, uint32_t datalen) {
+  static const char* hex = "0123456789abcdef";
+  std::string s;
+  for (uint32_t i = 0; i < datalen; ++i) {
+    uint8_t c = static_cast<const uint8_t*>(data)[i];
+    s += hex[c >> 4];
+    s += hex[c & 0x0f];
+  }
+  print(s);
+}
+
+template<typename Arg, typename... Args>
+void print(Arg&& a, Args&&... args) {
+  print(std::forward<Arg>(a));
+  if constexpr (sizeof...(args) > 0)
+    print(std::forward<Args>(args)...);
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Aggregate reflection for the host build. eosio.cdt generates serializers
+// for every struct reachable from an action or table; on the host plain
+// aggregates are decomposed with structured bindings instead.
+namespace eosio { namespace reflect {
+
+struct any_field {
+  template<typename T, typename = std::enable_if_t<!std::is_lvalue_reference_v<T>>>
+  constexpr operator T() const;
+};
+
+template<typename T, size_t... I>
+constexpr auto constructible(std::index_sequence<I...>)
+    -> decltype(T{(void(I), any_field{})...}, std::true_type{});
+
+template<typename T, typename Seq>
+constexpr std::false_type constructible(Seq, ...);
+
+template<typename T, size_t N>
+constexpr bool constructible_with = decltype(constructible<T>(std::make_index_sequence<N>{}))::value;
+
+template<typename T, size_t N = 0>
+constexpr size_t field_count() {
+  if constexpr (N > 16)
+    return N;
+  else if constexpr (constructible_with<T, N> && !constructible_with<T, N + 1>)
+    return N;
+  else
+    return field_count<T, N + 1>();
+}
+
+template<typename T>
+constexpr bool is_reflectable = std::is_class_v<T> && std::is_aggregate_v<T> && !std::is_empty_v<T>;
+
+// Calls f(fields...) with references to every field of `obj`.
+template<typename T, typename F>
+decltype(auto) apply(T& obj, F&& f) {
+  constexpr size_t n = field_count<std::remove_const_t<T>>();
+  static_assert(n > 0 && n <= 16, "unsupported aggregate");
+  if constexpr (n == 1) { auto& [a] = obj; return f(a); }
+  else if constexpr (n == 2) { auto& [a, b] = obj; return f(a, b); }
+  else if constexpr (n == 3) { auto& [a, b, c] = obj; return f(a, b, c); }
+  else if constexpr (n == 4) { auto& [a, b, c, d] = obj; return f(a, b, c, d); }
+  else if constexpr (n == 5) { auto& [a, b, c, d, e] = obj; return f(a, b, c, d, e); }
+  else if constexpr (n == 6) { auto& [a, b, c, d, e, g] = obj; return f(a, b, c, d, e, g); }
+  else if constexpr (n == 7) { auto& [a, b, c, d, e, g, h] = obj; return f(a, b, c, d, e, g, h); }
+  else if constexpr (n == 8) { auto& [a, b, c, d, e, g, h, i] = obj; return f(a, b, c, d, e, g, h, i); }
+  else if constexpr (n == 9) { auto& [a, b, c, d, e, g, h, i, j] = obj; return f(a, b, c, d, e, g, h, i, j); }
+  else if constexpr (n == 10) { auto& [a, b, c, d, e, g, h, i, j, k] = obj; return f(a, b, c, d, e, g, h, i, j, k); }
+  else if constexpr (n == 11) { auto& [a, b, c, d, e, g, h, i, j, k, l] = obj; return f(a, b, c, d, e, g, h, i, j, k, l); }
+  else if constexpr (n == 12) { auto& [a, b, c, d, e, g, h, i, j, k, l, m] = obj; return f(a, b, c, d, e, g, h, i, j, k, l, m); }
+  else if constexpr (n == 13) { auto& [a, b, c, d, e, g, h, i, j, k, l, m, o] = obj; return f(a, b, c, d, e, g, h, i, j, k, l, m, o); }
+  else if constexpr (n == 14) { auto& [a, b, c, d, e, g, h, i, j, k, l, m, o, p] = obj; return f(a, b, c, d, e, g, h, i, j, k, l, m, o, p); }
+  else if constexpr (n == 15) { auto& [a, b, c, d, e, g, h, i, j, k, l, m, o, p, q] = obj; return f(a, b, c, d, e, g, h, i, j, k, l, m, o, p, q); }
+  else { auto& [a, b, c, d, e, g, h, i, j, k, l, m, o, p, q, r] = obj; return f(a, b, c, d, e, g, h, i, j, k, l, m, o, p, q, r); }
+}
+
+}}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <eosio/check.hpp>
+#include <eosio/name.hpp>
+#include <eosio/time.hpp>
+
+namespace eosio {
+
+// Implemented by the simulated chain (sim/chain.cpp).
+void require_auth(name n);
+bool has_auth(name n);
+bool is_account(name n);
+void require_recipient(name notify_account);
+name current_receiver();
+time_point current_time_point();
+uint32_t current_block_number();
+
+template<typename... Accounts>
+void require_recipient(name notify_account, Accounts... remaining) {
+  require_recipient(notify_account);
+  require_recipient(remaining...);
+}
+
+inline time_point_sec current_time_point_sec() { return time_point_sec(current_time_point()); }
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <eosio/datastream.hpp>
+
+#include <cstdint>
+
+namespace eosio {
+
+class microseconds {
+public:
+  explicit microseconds(int64_t c = 0) : _count(c) {}
+  int64_t count() const { return _count; }
+  friend bool operator==(const microseconds& a, const microseconds& b) { return a._count == b._count; }
+  friend bool operator<(const microseconds& a, const microseconds& b) { return a._count < b._count; }
+  friend microseconds operator+(const microseconds& a, const microseconds& b) { return microseconds(a._count + b._count); }
+  friend microseconds operator-(const microseconds& a, const microseconds& b) { return microseconds(a._count - b._count); }
+  int64_t _count;
+
+  template<typename DataStream>
+  friend DataStream& operator<<(DataStream& ds, const microseconds& m) { return ds << m._count; }
+  template<typename DataStream>
+  friend DataStream& operator>>(DataStream& ds, microseconds& m) { return ds >> m._count; }
+};
+
+inline microseconds seconds(int64_t s) { return microseconds(s * 1000000); }
+
+class time_point {
+public:
+  explicit time_point(microseconds e = microseconds()) : elapsed(e) {}
+  const microseconds& time_since_epoch() const { return elapsed; }
+  uint32_t sec_since_epoch() const { return uint32_t(elapsed.count() / 1000000); }
+  friend bool operator<(const time_point& a, const time_point& b) { return a.elapsed < b.elapsed; }
+  microseconds elapsed;
+
+  template<typename DataStream>
+  friend DataStream& operator<<(DataStream& ds, const time_point& t) { return ds << t.elapsed; }
+  template<typename DataStream>
+  friend DataStream& operator>>(DataStream& ds, time_point& t) { return ds >> t.elapsed; }
+};
+
+class time_point_sec {
+public:
+  time_point_sec() : utc_seconds(0) {}
+  explicit time_point_sec(uint32_t seconds) : utc_seconds(seconds) {}
+  time_point_sec(const time_point& t) : utc_seconds(uint32_t(t.time_since_epoch().count() / 1000000ll)) {}
+  uint32_t sec_since_epoch() const { return utc_seconds; }
+  friend bool operator<(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds < b.utc_seconds; }
+  friend bool operator==(const time_point_sec& a, const time_point_sec& b) { return a.utc_seconds == b.utc_seconds; }
+  uint32_t utc_seconds;
+
+  template<typename DataStream>
+  friend DataStream& operator<<(DataStream& ds, const time_point_sec& t) { return ds << t.utc_seconds; }
+  template<typename DataStream>
+  friend DataStream& operator>>(DataStream& ds, time_point_sec& t) { return ds >> t.utc_seconds; }
+};
+
+}
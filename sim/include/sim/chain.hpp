@@ -0,0 +1,138 @@
+#pragma once
+
+#include <eosio/action.hpp>
+#include <eosio/check.hpp>
+#include <eosio/contract.hpp>
+#include <eosio/datastream.hpp>
+#include <eosio/name.hpp>
+#include <eosio/time.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// In-process stand-in for a chain: accounts, contract dispatch, inline
+// actions and notifications executed synchronously, and transactions that
+// roll back every database change when an action fails.
+namespace sim {
+
+using eosio::name;
+
+// Database traffic, accumulated over everything that ran since the last
+// reset_counters().
+struct counters {
+  uint64_t rows_read = 0;
+  uint64_t bytes_read = 0;
+  uint64_t rows_written = 0;
+  uint64_t bytes_written = 0;
+  uint64_t rows_erased = 0;
+  uint64_t index_writes = 0;
+  uint64_t actions = 0;
+};
+
+using apply_handler = std::function<void(name receiver, name code, name action, const std::vector<char>& data)>;
+
+void create_account(name account);
+void set_contract(name account, apply_handler handler);
+
+// Runs the actions as one transaction. Throws eosio::eosio_assert_exception
+// after rolling the database back when any of them fails.
+void push_transaction(const std::vector<eosio::action>& actions);
+inline void push_action(const eosio::action& act) { push_transaction({act}); }
+
+void set_time(eosio::time_point now);
+void produce_block(uint32_t seconds = 1);
+
+const counters& get_counters();
+void reset_counters();
+
+// Everything printed by contracts since the last call.
+std::string take_console();
+
+namespace detail {
+
+inline std::vector<char>& return_value() {
+  static std::vector<char> value;
+  return value;
+}
+
+template<typename Contract, typename R, typename... Args>
+void invoke(name receiver, name code, const std::vector<char>& data, R (Contract::*method)(Args...)) {
+  std::tuple<std::decay_t<Args>...> args;
+  eosio::datastream<const char*> ds(data.data(), data.size());
+  ds >> args;
+  // on the heap, gcc loses track of a local one through the member pointer
+  // call and takes it for uninitialized
+  auto obj = std::make_unique<Contract>(receiver, code, eosio::datastream<const char*>(data.data(), data.size()));
+  if constexpr (std::is_void_v<R>) {
+    std::apply([&](auto&... a){ ((*obj).*method)(a...); }, args);
+  } else {
+    auto result = std::apply([&](auto&... a){ return ((*obj).*method)(a...); }, args);
+    return_value() = eosio::pack(result);
+  }
+}
+
+}
+
+// Packed return value of the last action that returned one, like
+// set_action_return_value on chain.
+template<typename T>
+T take_return() {
+  auto value = eosio::unpack<T>(detail::return_value());
+  detail::return_value().clear();
+  return value;
+}
+
+// Builds the apply handler of a contract, the host counterpart of the
+// dispatcher eosio.cdt generates from [[eosio::action]] and
+// [[eosio::on_notify]] attributes.
+template<typename Contract>
+class dispatcher {
+public:
+  template<typename R, typename... Args>
+  dispatcher& action(name act, R (Contract::*method)(Args...)) {
+    _actions[act.value] = [method](name receiver, name code, const std::vector<char>& data) {
+      detail::invoke(receiver, code, data, method);
+    };
+    return *this;
+  }
+
+  // `code` may be name() to match any sender, like "*::action"
+  template<typename R, typename... Args>
+  dispatcher& notify(name code, name act, R (Contract::*method)(Args...)) {
+    _notifications[{code.value, act.value}] = [method](name receiver, name code, const std::vector<char>& data) {
+      detail::invoke(receiver, code, data, method);
+    };
+    return *this;
+  }
+
+  operator apply_handler() const {
+    auto actions = _actions;
+    auto notifications = _notifications;
+    return [actions, notifications](name receiver, name code, name act, const std::vector<char>& data) {
+      if (receiver == code) {
+        auto it = actions.find(act.value);
+        eosio::check(it != actions.end(), "unknown action " + act.to_string());
+        it->second(receiver, code, data);
+        return;
+      }
+      auto it = notifications.find({code.value, act.value});
+      if (it == notifications.end())
+        it = notifications.find({0, act.value});
+      if (it != notifications.end())
+        it->second(receiver, code, data);
+    };
+  }
+
+private:
+  using handler = std::function<void(name, name, const std::vector<char>&)>;
+  std::map<uint64_t, handler> _actions;
+  std::map<std::pair<uint64_t, uint64_t>, handler> _notifications;
+};
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <eosio/name.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+typedef unsigned __int128 uint128_t;
+
+// Database primitives of the simulated chain, the host counterpart of the
+// db_*_i64 / db_idx*_ intrinsics multi_index is built on. Rows are kept
+// serialized so that bytes read and written can be accounted for.
+namespace sim { namespace db {
+
+using eosio::name;
+
+struct table_ref {
+  uint64_t code;
+  uint64_t scope;
+  uint64_t table;
+};
+
+// primary rows
+const std::vector<char>* get(const table_ref& t, uint64_t pk);
+void store(const table_ref& t, name payer, uint64_t pk, std::vector<char> data);
+void update(const table_ref& t, name payer, uint64_t pk, std::vector<char> data);
+void remove(const table_ref& t, uint64_t pk);
+
+std::optional<uint64_t> first(const table_ref& t);
+std::optional<uint64_t> last(const table_ref& t);
+std::optional<uint64_t> next(const table_ref& t, uint64_t pk);
+std::optional<uint64_t> prev(const table_ref& t, uint64_t pk);
+std::optional<uint64_t> lower_bound(const table_ref& t, uint64_t pk);
+std::optional<uint64_t> upper_bound(const table_ref& t, uint64_t pk);
+
+// secondary indices, keys are widened to 128 bits
+using secondary_entry = std::pair<uint128_t, uint64_t>;
+
+void idx_store(const table_ref& t, uint32_t index, uint64_t pk, uint128_t key);
+void idx_update(const table_ref& t, uint32_t index, uint64_t pk, uint128_t key);
+void idx_remove(const table_ref& t, uint32_t index, uint64_t pk);
+
+std::optional<secondary_entry> idx_first(const table_ref& t, uint32_t index);
+std::optional<secondary_entry> idx_last(const table_ref& t, uint32_t index);
+std::optional<secondary_entry> idx_next(const table_ref& t, uint32_t index, const secondary_entry& at);
+std::optional<secondary_entry> idx_prev(const table_ref& t, uint32_t index, const secondary_entry& at);
+std::optional<secondary_entry> idx_lower_bound(const table_ref& t, uint32_t index, uint128_t key);
+std::optional<secondary_entry> idx_upper_bound(const table_ref& t, uint32_t index, uint128_t key);
+std::optional<secondary_entry> idx_find_primary(const table_ref& t, uint32_t index, uint64_t pk);
+
+}}
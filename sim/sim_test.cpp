@@ -0,0 +1,489 @@
+// Runs random issue, transfer and retire flows against the host builds of
+// ertc and ertc.nft and checks the nft tables after every action against a
+// plain model of who holds which id on which cell. Exits non-zero on the
+// first failure of every check.
+// Usage: sim_test [steps] [seed]
+
+#include <contracts.hpp>
+#include <ertc.hpp>
+#include <ertc.nft.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+using eosio::name;
+using eosio::asset;
+using eosio::symbol;
+using ertc::nft;
+
+const name NFT = "ertc.nft"_n;
+// issuer of the token, so its own issues and direct ones both go through
+const name ERTC = "ertc"_n;
+const symbol SYM{"ERTC", 0};
+
+using id_list = std::set<id_type>;
+
+std::mt19937_64 rng;
+int failures = 0;
+size_t step = 0;
+
+uint64_t below(uint64_t n) { return n ? rng() % n : 0; }
+
+// Reports the first failure of a check, later ones only count.
+bool expect(bool ok, const char* check, const std::string& detail = "") {
+  static std::set<std::string> reported;
+  if (!ok && reported.insert(check).second) {
+    std::printf("FAIL %s, step %zu:%s\n", check, step, detail.c_str());
+    ++failures;
+  }
+  return ok;
+}
+
+// Pushes one action as a transaction, false when the contract rejected it.
+template<typename... Args>
+bool push_to(name account, name act, name actor, const Args&... args) {
+  eosio::action a;
+  a.account = account;
+  a.name = act;
+  a.authorization = {{actor, "active"_n}};
+  a.data = eosio::pack(std::make_tuple(args...));
+  try {
+    sim::push_action(a);
+  } catch (const std::exception&) {
+    sim::take_console();
+    return false;
+  }
+  sim::take_console();
+  return true;
+}
+
+template<typename... Args>
+bool push(name act, name actor, const Args&... args) {
+  return push_to(NFT, act, actor, args...);
+}
+
+interval_set to_intervals(const id_list& ids) {
+  interval_set result;
+  for (auto id: ids) {
+    if (!result.empty() && result.back().second + 1 == id)
+      result.back().second = id;
+    else
+      result.push_back({id, id});
+  }
+  return result;
+}
+
+std::string describe(const interval_set& ids) {
+  std::string s;
+  for (const auto& range: ids)
+    s += " [" + std::to_string(range.first) + "," + std::to_string(range.second) + "]";
+  return s.empty() ? " (empty)" : s;
+}
+
+bool same_cell(const point& a, const point& b) {
+  return a.latitude == b.latitude && a.longitude == b.longitude;
+}
+
+// The model: ids each account holds and the cell of every live id.
+std::vector<name> users;
+std::map<name, id_list> held;
+std::map<id_type, point> cells;
+id_type next_id = 0;
+uint64_t next_region = 0;
+
+// Every issue gets a 64 x 64 region of its own, on both sides of 0.
+point new_region() {
+  uint64_t r = next_region++;
+  return {(int64_t(r % 16) - 8) * 64, (int64_t(r / 16) - 8) * 64};
+}
+
+name random_user() { return users[below(users.size())]; }
+
+name random_holder() {
+  std::vector<name> holders;
+  for (const auto& [owner, ids]: held)
+    if (!ids.empty())
+      holders.push_back(owner);
+  return holders.empty() ? name() : holders[below(holders.size())];
+}
+
+name other_user(name from) {
+  name to;
+  while ((to = random_user()) == from);
+  return to;
+}
+
+// Up to `count` ids of `ids`, picked one at a time or as short runs.
+id_list pick(const id_list& ids, size_t count) {
+  std::vector<id_type> all(ids.begin(), ids.end());
+  id_list result;
+  while (result.size() < count) {
+    size_t at = below(all.size());
+    for (size_t n = 1 + (below(2) ? 0 : below(6)); n > 0 && at < all.size() && result.size() < count; --n)
+      result.insert(all[at++]);
+  }
+  return result;
+}
+
+// The `amount` highest ids of `ids`, taken out of it.
+id_list take_back(id_list& ids, int64_t amount) {
+  id_list taken;
+  for (; amount > 0; --amount) {
+    taken.insert(*ids.rbegin());
+    ids.erase(std::prev(ids.end()));
+  }
+  return taken;
+}
+
+void move_ids(name from, name to, const id_list& ids) {
+  for (auto id: ids) {
+    held[from].erase(id);
+    held[to].insert(id);
+  }
+}
+
+void issue_cells() {
+  point base = new_region();
+  std::vector<point> coords;
+  std::set<std::pair<int64_t, int64_t>> used;
+  size_t count = 1 + below(60);
+  while (coords.size() < count) {
+    point pt{base.latitude + int64_t(below(64)), base.longitude + int64_t(below(64))};
+    if (used.insert({pt.latitude, pt.longitude}).second)
+      coords.push_back(pt);
+  }
+
+  name to = random_user();
+  bool ok = push("issue"_n, ERTC, to, asset{int64_t(count), SYM}, coords, uint64_t(next_region), std::string());
+  if (!expect(ok, "issue"))
+    return;
+  for (const auto& pt: coords) {
+    held[to].insert(next_id);
+    cells[next_id++] = pt;
+  }
+}
+
+void issue_rect() {
+  point base = new_region();
+  std::vector<points_pair> areas;
+  int64_t amount = 0;
+  // one or two areas, side by side in the region
+  for (int64_t k = 0, n = 1 + below(2); k < n; ++k) {
+    point low{base.latitude + int64_t(below(8)), base.longitude + 32 * k + int64_t(below(8))};
+    point high{low.latitude + int64_t(below(16)), low.longitude + int64_t(below(16))};
+    areas.push_back({low, high});
+    amount += (high.latitude - low.latitude + 1) * (high.longitude - low.longitude + 1);
+  }
+
+  name to = random_user();
+  bool ok = push("issuerect"_n, ERTC, to, asset{amount, SYM}, areas, uint64_t(next_region), std::string());
+  if (!expect(ok, "issuerect"))
+    return;
+  for (const auto& area: areas) {
+    for (uint64_t offset = 0, n = points_range_length(area); offset < n; ++offset) {
+      held[to].insert(next_id);
+      cells[next_id++] = range_point(area, offset);
+    }
+  }
+}
+
+// A validation over the triangle with legs of 20 along both axes from a
+// region's corner, cell (a, b) of the region is in it when a + b <= 18.
+// ertc issues areas inside it and refuses areas outside or crossing the
+// hypotenuse.
+void issue_validation() {
+  point base = new_region();
+  uint64_t id = next_region;
+  std::vector<point> polygon{base, {base.latitude, base.longitude + 20}, {base.latitude + 20, base.longitude}};
+  name creator = random_user();
+  if (!expect(push_to(ERTC, "create"_n, creator, creator, id, polygon, int64_t(190)), "create validation") ||
+      !expect(push_to(ERTC, "approve"_n, ERTC, id), "approve") ||
+      !expect(push_to(ERTC, "preissue"_n, ERTC, id), "preissue"))
+    return;
+
+  auto area = [&](int64_t a, int64_t b, int64_t height, int64_t width) {
+    return points_pair{{base.latitude + a, base.longitude + b}, {base.latitude + a + height - 1, base.longitude + b + width - 1}};
+  };
+  auto issue = [&](const points_pair& range) {
+    return push_to(ERTC, "issuerect"_n, ERTC, id, int64_t(points_range_length(range)), std::vector<points_pair>{range});
+  };
+  int64_t corner = 15 + below(4), a = below(corner + 1);
+  expect(!issue(area(a, corner - a, 3, 3)), "issuerect crossing the polygon");
+  a = below(20);
+  expect(!issue(area(a, 20 - a + below(10), 1 + below(4), 1 + below(4))), "issuerect outside the polygon");
+
+  int64_t height = 1 + below(4), width = 1 + below(4);
+  a = below(21 - height - width);
+  int64_t b = below(21 - height - width - a);
+  auto inside = area(a, b, height, width);
+  if (!expect(issue(inside), "issuerect inside the polygon"))
+    return;
+  for (uint64_t offset = 0, n = points_range_length(inside); offset < n; ++offset) {
+    held[ERTC].insert(next_id);
+    cells[next_id++] = range_point(inside, offset);
+  }
+}
+
+// Cells of live ids are taken, an issue onto one fails and reserves nothing.
+void issue_taken() {
+  if (cells.empty())
+    return;
+  auto it = cells.lower_bound(below(next_id));
+  if (it == cells.end())
+    it = cells.begin();
+  point pt = it->second;
+  bool ok = below(2)
+    ? push("issue"_n, ERTC, random_user(), asset{1, SYM}, std::vector<point>{pt}, uint64_t(0), std::string())
+    : push("issuerect"_n, ERTC, random_user(), asset{1, SYM}, std::vector<points_pair>{{pt, pt}}, uint64_t(0), std::string());
+  expect(!ok, "issue onto a taken cell", " " + std::to_string(pt.latitude) + "," + std::to_string(pt.longitude));
+}
+
+void transfer() {
+  name from = random_holder();
+  if (from == name())
+    return;
+  name to = other_user(from);
+  int64_t amount = 1 + below(std::min<size_t>(held[from].size(), 80));
+  if (!expect(push("transfer"_n, from, from, to, asset{amount, SYM}, std::string()), "transfer"))
+    return;
+  move_ids(from, to, take_back(held[from], amount));
+}
+
+void transferid() {
+  name from = random_holder();
+  if (from == name())
+    return;
+  name to = other_user(from);
+  id_type id = *pick(held[from], 1).begin();
+  if (!expect(push("transferid"_n, from, from, to, id, std::string()), "transferid"))
+    return;
+  move_ids(from, to, {id});
+}
+
+void transferids() {
+  name from = random_holder();
+  if (from == name())
+    return;
+  name to = other_user(from);
+  id_list ids = pick(held[from], 1 + below(std::min<size_t>(held[from].size(), 40)));
+  bool ok = push("transferids"_n, from, from, to, asset{int64_t(ids.size()), SYM}, to_intervals(ids), std::string());
+  if (!expect(ok, "transferids"))
+    return;
+  move_ids(from, to, ids);
+}
+
+// Several recipients at once, either of the sender's last ids or of ids it
+// picks. The first recipient gets the lowest ids.
+void transferbatch() {
+  name from = random_holder();
+  if (from == name())
+    return;
+  std::vector<std::pair<name, asset>> transfers;
+  int64_t total = 0;
+  for (size_t n = 1 + below(4); n > 0 && total < int64_t(held[from].size()); --n) {
+    int64_t amount = 1 + below(std::min<int64_t>(held[from].size() - total, 20));
+    transfers.push_back({other_user(from), asset{amount, SYM}});
+    total += amount;
+  }
+
+  id_list ids = below(2) ? pick(held[from], total) : id_list();
+  bool ok = push("transferbatch"_n, from, from, transfers, to_intervals(ids), std::string());
+  if (!expect(ok, "transferbatch"))
+    return;
+  if (ids.empty())
+    ids = take_back(held[from], total);
+  auto next = ids.begin();
+  for (const auto& [to, quantity]: transfers) {
+    id_list slice;
+    for (int64_t i = 0; i < quantity.amount; ++i)
+      slice.insert(*next++);
+    move_ids(from, to, slice);
+  }
+}
+
+void retire() {
+  name owner = random_holder();
+  if (owner == name())
+    return;
+  id_list ids = pick(held[owner], 1 + below(std::min<size_t>(held[owner].size(), 40)));
+  bool ok = push("retire"_n, owner, owner, asset{int64_t(ids.size()), SYM}, to_intervals(ids), std::string());
+  if (!expect(ok, "retire"))
+    return;
+  for (auto id: ids) {
+    held[owner].erase(id);
+    cells.erase(id);
+  }
+}
+
+// tokensinbox finds the live ids on the cells of a box, token rows and
+// block pieces alike, each once; with a limit, that many of them.
+void tokens_in_box() {
+  if (cells.empty())
+    return;
+  auto it = cells.lower_bound(below(next_id));
+  if (it == cells.end())
+    it = cells.begin();
+  point centre = it->second;
+  int64_t reach = below(2) ? below(8) : below(100);
+  points_pair box{{centre.latitude - int64_t(below(reach + 1)), centre.longitude - int64_t(below(reach + 1))},
+                  {centre.latitude + int64_t(below(reach + 1)), centre.longitude + int64_t(below(reach + 1))}};
+  if (below(2))
+    std::swap(box.first, box.second);
+
+  id_list expected;
+  for (const auto& [id, cell]: cells)
+    if (ranges_overlap(normalize_range(box), {cell, cell}))
+      expected.insert(id);
+
+  uint32_t limit = below(4) ? 1000000 : 1 + below(expected.size() + 1);
+  if (!expect(push("tokensinbox"_n, ERTC, box, limit), "tokensinbox"))
+    return;
+  auto found = sim::take_return<std::vector<id_type>>();
+  id_list distinct(found.begin(), found.end());
+  bool within = std::includes(expected.begin(), expected.end(), distinct.begin(), distinct.end());
+  expect(distinct.size() == found.size() && within && found.size() == std::min<size_t>(limit, expected.size()), "tokensinbox ids",
+         " " + std::to_string(found.size()) + " ids for " + std::to_string(expected.size()) + ", limit " + std::to_string(limit));
+}
+
+// Pages of every account hold exactly its ids, in disjoint ascending pages
+// of at most PAGE_BYTES, and its balance counts them.
+void check_accounts() {
+  int64_t supply = 0;
+  for (const auto& [owner, ids]: held) {
+    supply += ids.size();
+
+    nft::page_index pages(NFT, owner.value);
+    auto by_start = pages.get_index<"bystart"_n>();
+    interval_set in_pages;
+    bool ordered = true, sized = true;
+    for (const auto& pg: by_start) {
+      auto part = decode_intervals(pg.tokens);
+      sized = sized && !part.empty() && pg.tokens.data.size() <= nft::PAGE_BYTES && pg.sym == SYM.code();
+      ordered = ordered && (in_pages.empty() || part.empty() || in_pages.back().second < part.front().first);
+      in_pages.insert(in_pages.end(), part.begin(), part.end());
+    }
+    expect(ordered, "pages ordered and disjoint", " " + owner.to_string());
+    expect(sized, "page size", " " + owner.to_string());
+
+    // pages may cut an interval, the ids have to be the same
+    id_list from_pages;
+    for (const auto& range: in_pages)
+      for (id_type id = range.first; id <= range.second; ++id)
+        from_pages.insert(id);
+    expect(from_pages == ids, "page ids", " " + owner.to_string() + ":" + describe(in_pages) + " expected" + describe(to_intervals(ids)));
+
+    nft::account_index accounts(NFT, owner.value);
+    auto row = accounts.find(SYM.code().raw());
+    int64_t balance = row == accounts.end() ? 0 : row->balance.amount;
+    expect(balance == int64_t(ids.size()), "balance", " " + owner.to_string() + " " + std::to_string(balance) + " for " + std::to_string(ids.size()));
+  }
+
+  nft::currency_index stat(NFT, SYM.code().raw());
+  auto st = stat.find(SYM.code().raw());
+  expect(st != stat.end() && st->supply.amount == supply, "supply");
+}
+
+// Every live id has either a token row or a place in a block piece, on
+// the cell it was issued for.
+void check_tokens() {
+  id_list recorded;
+  bool placed = true, single = true;
+  nft::token_v2_index tokens(NFT, NFT.value);
+  for (const auto& t: tokens) {
+    auto cell = cells.find(t.id);
+    placed = placed && cell != cells.end() && same_cell(cell->second, t.coords);
+    single = single && recorded.insert(t.id).second;
+  }
+  nft::block_index blocks(NFT, NFT.value);
+  for (const auto& b: blocks) {
+    for (id_type id = b.first_id; id <= b.last_id; ++id) {
+      auto cell = cells.find(id);
+      placed = placed && cell != cells.end() && same_cell(cell->second, range_point(b.area, b.offset + (id - b.first_id)));
+      single = single && recorded.insert(id).second;
+    }
+  }
+  expect(placed, "token cells");
+  expect(single, "token rows and blocks disjoint");
+
+  id_list live;
+  for (const auto& entry: cells)
+    live.insert(entry.first);
+  expect(recorded == live, "tokens of live ids");
+}
+
+// Owner ranges are disjoint, ascending, joined where one owner's meet and
+// cover exactly the live ids, each with its holder.
+void check_owners() {
+  std::map<id_type, name> owner_of;
+  for (const auto& [owner, ids]: held)
+    for (auto id: ids)
+      owner_of[id] = owner;
+
+  nft::owner_index ranges(NFT, NFT.value);
+  const nft::owner_range* prev = nullptr;
+  uint64_t covered = 0;
+  bool ordered = true, joined = true, owned = true;
+  for (const auto& r: ranges) {
+    ordered = ordered && r.first_id <= r.last_id && (!prev || prev->last_id < r.first_id);
+    joined = joined && !(prev && prev->last_id + 1 == r.first_id && prev->owner == r.owner);
+    for (id_type id = r.first_id; owned && id <= r.last_id; ++id) {
+      auto it = owner_of.find(id);
+      owned = it != owner_of.end() && it->second == r.owner;
+    }
+    covered += r.last_id - r.first_id + 1;
+    prev = &r;
+  }
+  expect(ordered, "owner ranges ordered and disjoint");
+  expect(joined, "owner ranges joined");
+  expect(owned, "owner ranges match holders");
+  expect(owned && covered == owner_of.size(), "owner ranges cover live ids", " " + std::to_string(covered) + " for " + std::to_string(owner_of.size()));
+}
+
+}
+
+int main(int argc, char** argv) {
+  size_t steps = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1500;
+  uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+  rng.seed(seed);
+
+  sim::deploy_nft(NFT);
+  sim::deploy_ertc(ERTC);
+  // few accounts, so their ids fragment over many pages
+  for (const char* account: {"alice", "bob", "carol", "dave", "erin"}) {
+    users.push_back(name(account));
+    sim::create_account(users.back());
+  }
+  expect(push("create"_n, NFT, ERTC, std::string("ERTC")), "create");
+
+  for (step = 0; step < steps; ++step) {
+    switch (below(step < 40 ? 2 : 12)) {
+      case 0: issue_cells(); break;
+      case 1: issue_rect(); break;
+      case 2: issue_taken(); break;
+      case 3: case 4: transfer(); break;
+      case 5: case 6: transferid(); break;
+      case 7: transferids(); break;
+      case 8: transferbatch(); break;
+      case 9: issue_validation(); break;
+      case 10: tokens_in_box(); break;
+      default: retire(); break;
+    }
+    // the checks go through every table, now and then is enough
+    if (step % 10 == 0 || step + 1 == steps) {
+      check_accounts();
+      check_tokens();
+      check_owners();
+    }
+  }
+
+  std::printf("%s (seed %lu)\n", failures ? "FAILED" : "passed", seed);
+  return failures ? 1 : 0;
+}
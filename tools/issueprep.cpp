@@ -0,0 +1,699 @@
+// Prepares ertc::issuepacked actions off-chain, so that batches with
+// duplicate cells, cells outside of the validation polygon or a wrong
+// amount are turned down before they cost any CPU or NET.
+//
+// Usage: issueprep --validation ID --polygon FILE [--amount N] [--cells FILE]
+//                  [--out FILE] [--contract NAME] [--cpu UNITS] [--net BYTES]
+//                  [--threads N] [--chunk CELLS] [--drop-outside]
+//
+//   --polygon    vertices of the validation polygon, in order
+//   --cells      cells to issue, standard input by default
+//   --amount     cells the batches must add up to, the validation amount
+//                less what was issued for it already
+//   --out        one JSON action per line, standard output by default
+//   --cpu        budget of an action in the issuestep cost model units,
+//                ertc::STEP_BUDGET by default
+//   --net        budget of the packed cells of an action in bytes
+//   --chunk      cells sorted and checked at a time by one thread
+//   --drop-outside  leave out cells outside of the polygon instead of
+//                failing
+//
+// Both files are CSV, a "lat,lon" pair per line with lines not starting
+// with a number skipped, or GeoJSON, where every [lon, lat] coordinate
+// pair is taken. Integers are grid cells, decimals are degrees with at
+// most ertc::POINT_DIGITS decimals.
+//
+// The cells are read in chunks. Every thread sorts a chunk, drops the
+// duplicates and the cells outside of the polygon and writes it to a
+// temporary run file. The runs are then merged in row-major order, which
+// drops the duplicates between chunks and keeps the cells of a tile
+// together. Memory stays at about (threads + 2) chunks whatever the
+// number of cells.
+
+#include <ertc.hpp>
+#include <ertc.nft.hpp>
+#include <raster.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using validation = ertc::ertc::validation;
+
+[[noreturn]] void fail(const std::string& message) {
+  throw std::runtime_error(message);
+}
+
+bool row_major(const point& a, const point& b) {
+  return a.latitude < b.latitude || (a.latitude == b.latitude && a.longitude < b.longitude);
+}
+
+bool same_cell(const point& a, const point& b) {
+  return a.latitude == b.latitude && a.longitude == b.longitude;
+}
+
+std::string to_string(const point& pt) {
+  return std::to_string(pt.latitude) + "," + std::to_string(pt.longitude);
+}
+
+// Buffered character input.
+class text_source {
+public:
+  explicit text_source(FILE* file) : file(file), buffer(1 << 20) {}
+
+  int peek() {
+    if (pos == end && !refill())
+      return EOF;
+    return static_cast<unsigned char>(buffer[pos]);
+  }
+
+  int get() {
+    int c = peek();
+    if (c != EOF) {
+      ++pos;
+      if (c == '\n')
+        ++line;
+    }
+    return c;
+  }
+
+  size_t line = 1;
+
+private:
+  bool refill() {
+    pos = 0;
+    end = std::fread(buffer.data(), 1, buffer.size(), file);
+    return end > 0;
+  }
+
+  FILE* file;
+  std::vector<char> buffer;
+  size_t pos = 0;
+  size_t end = 0;
+};
+
+bool starts_number(int c) {
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+// A coordinate in grid cells: an integer as it is, a decimal in degrees
+// scaled by 10^POINT_DIGITS. Exact, no floating point on the way.
+int64_t read_coordinate(text_source& in) {
+  bool negative = false;
+  if (in.peek() == '-' || in.peek() == '+')
+    negative = in.get() == '-';
+
+  constexpr int64_t limit = MAX_RASTER_COORD;
+  int64_t whole = 0, fraction = 0;
+  int digits = 0, decimals = -1;
+  for (;;) {
+    int c = in.peek();
+    if (c >= '0' && c <= '9') {
+      in.get();
+      ++digits;
+      if (decimals < 0) {
+        whole = whole * 10 + (c - '0');
+        if (whole > limit)
+          fail("line " + std::to_string(in.line) + ": coordinate out of range");
+      } else if (++decimals <= ertc::ertc::POINT_DIGITS) {
+        fraction = fraction * 10 + (c - '0');
+      } else if (c != '0') {
+        fail("line " + std::to_string(in.line) + ": more than " + std::to_string(ertc::ertc::POINT_DIGITS) + " decimals");
+      }
+    } else if (c == '.' && decimals < 0) {
+      in.get();
+      decimals = 0;
+    } else {
+      break;
+    }
+  }
+  if (digits == 0)
+    fail("line " + std::to_string(in.line) + ": number expected");
+  if (in.peek() == 'e' || in.peek() == 'E')
+    fail("line " + std::to_string(in.line) + ": exponents are not supported");
+
+  int64_t value = whole;
+  if (decimals >= 0) {
+    for (int i = 0; i < ertc::ertc::POINT_DIGITS; ++i) {
+      value *= 10;
+      if (value > limit)
+        fail("line " + std::to_string(in.line) + ": coordinate out of range");
+    }
+    for (int i = std::min<int>(decimals, ertc::ertc::POINT_DIGITS); i < ertc::ertc::POINT_DIGITS; ++i)
+      fraction *= 10;
+    value += fraction;
+  }
+  return negative ? -value : value;
+}
+
+class point_reader {
+public:
+  virtual ~point_reader() = default;
+  virtual bool next(point& pt) = 0;
+};
+
+// "lat,lon" per line, separated by a comma, semicolon or blanks
+class csv_reader : public point_reader {
+public:
+  explicit csv_reader(text_source& in) : in(in) {}
+
+  bool next(point& pt) override {
+    for (;;) {
+      skip_blanks();
+      int c = in.peek();
+      if (c == EOF)
+        return false;
+      if (!starts_number(c)) {
+        skip_line();
+        continue;
+      }
+      pt.latitude = read_coordinate(in);
+      skip_blanks();
+      if (in.peek() == ',' || in.peek() == ';')
+        in.get();
+      skip_blanks();
+      if (!starts_number(in.peek()))
+        fail("line " + std::to_string(in.line) + ": longitude expected");
+      pt.longitude = read_coordinate(in);
+      skip_line();
+      return true;
+    }
+  }
+
+private:
+  void skip_blanks() {
+    while (in.peek() == ' ' || in.peek() == '\t' || in.peek() == '\r')
+      in.get();
+  }
+
+  void skip_line() {
+    for (int c = in.get(); c != EOF && c != '\n'; c = in.get());
+  }
+
+  text_source& in;
+};
+
+// Every innermost array of two or three numbers under a "coordinates" key,
+// [lon, lat] as GeoJSON has it. The rest of the document is skipped.
+class geojson_reader : public point_reader {
+public:
+  explicit geojson_reader(text_source& in) : in(in) {}
+
+  bool next(point& pt) override {
+    for (int c = in.peek(); c != EOF; c = in.peek()) {
+      if (depth > 0 && starts_number(c)) {
+        numbers.push_back(read_coordinate(in));
+        continue;
+      }
+      in.get();
+      if (c == '"') {
+        armed = read_string() == "coordinates" && depth == 0;
+      } else if (c == '[' && (armed || depth > 0)) {
+        ++depth;
+        numbers.clear();
+      } else if (c == ']' && depth > 0) {
+        bool pair = numbers.size() == 2 || numbers.size() == 3;
+        if (--depth == 0)
+          armed = false;
+        if (pair) {
+          pt = {numbers[1], numbers[0]};
+          numbers.clear();
+          return true;
+        }
+        numbers.clear();
+      }
+    }
+    if (depth > 0)
+      fail("unterminated coordinates array");
+    return false;
+  }
+
+private:
+  std::string read_string() {
+    std::string s;
+    for (int c = in.get(); c != EOF && c != '"'; c = in.get()) {
+      if (c == '\\')
+        c = in.get();
+      s += char(c);
+    }
+    return s;
+  }
+
+  text_source& in;
+  bool armed = false;
+  size_t depth = 0;
+  std::vector<int64_t> numbers;
+};
+
+std::unique_ptr<point_reader> open_reader(text_source& in) {
+  while (in.peek() == ' ' || in.peek() == '\t' || in.peek() == '\r' || in.peek() == '\n')
+    in.get();
+  if (in.peek() == '{' || in.peek() == '[')
+    return std::make_unique<geojson_reader>(in);
+  return std::make_unique<csv_reader>(in);
+}
+
+FILE* open_file(const std::string& path, const char* mode) {
+  FILE* f = std::fopen(path.c_str(), mode);
+  if (!f)
+    fail(path + ": " + std::strerror(errno));
+  return f;
+}
+
+std::vector<point> read_polygon(const std::string& path) {
+  FILE* f = open_file(path, "rb");
+  text_source in(f);
+  std::vector<point> vertices;
+  auto reader = open_reader(in);
+  point pt;
+  while (reader->next(pt))
+    vertices.push_back(pt);
+  std::fclose(f);
+
+  // GeoJSON rings repeat the first vertex at the end
+  if (vertices.size() > 1 && same_cell(vertices.front(), vertices.back()))
+    vertices.pop_back();
+  if (vertices.size() < 3)
+    fail(path + ": a polygon needs at least three vertices");
+  return vertices;
+}
+
+// Chunks of cells handed from the reader to the workers; push blocks while
+// `capacity` chunks are waiting, so reading never runs far ahead.
+class chunk_queue {
+public:
+  explicit chunk_queue(size_t capacity) : capacity(capacity) {}
+
+  void push(std::vector<point> chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [&]{ return chunks.size() < capacity; });
+    chunks.push_back(std::move(chunk));
+    not_empty.notify_one();
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    not_empty.notify_all();
+  }
+
+  std::optional<std::vector<point>> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [&]{ return !chunks.empty() || closed; });
+    if (chunks.empty())
+      return std::nullopt;
+    auto chunk = std::move(chunks.front());
+    chunks.pop_front();
+    not_full.notify_one();
+    return chunk;
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable not_empty, not_full;
+  std::deque<std::vector<point>> chunks;
+  size_t capacity;
+  bool closed = false;
+};
+
+struct totals {
+  uint64_t read = 0;
+  uint64_t duplicates = 0;
+  uint64_t outside = 0;
+  std::vector<point> outside_examples;
+};
+
+// Sorted, checked chunks in temporary files.
+struct run_file {
+  FILE* file;
+  uint64_t cells;
+};
+
+class chunk_checker {
+public:
+  explicit chunk_checker(const validation& v) : v(v) {}
+
+  // sorts and dedups the chunk, takes out the cells outside of the polygon
+  // and stores the rest as a run
+  void check(std::vector<point>& chunk) {
+    std::sort(chunk.begin(), chunk.end(), row_major);
+    size_t before = chunk.size();
+    chunk.erase(std::unique(chunk.begin(), chunk.end(), same_cell), chunk.end());
+    uint64_t duplicates = before - chunk.size();
+
+    std::vector<point> outside;
+    if (!spans_inside(v.coordinates, row_runs(chunk.begin(), chunk.end()))) {
+      // rare, so the cells are gone through row by row to find them
+      auto kept = chunk.begin();
+      for (auto row = chunk.begin(); row != chunk.end();) {
+        auto row_end = std::find_if(row, chunk.end(), [&](const point& pt){ return pt.latitude != row->latitude; });
+        bool inside = spans_inside(v.coordinates, row_runs(row, row_end));
+        for (auto it = row; it != row_end; ++it) {
+          if (inside || cells_inside(v.coordinates, {*it}))
+            *kept++ = *it;
+          else
+            outside.push_back(*it);
+        }
+        row = row_end;
+      }
+      chunk.erase(kept, chunk.end());
+    }
+
+    FILE* file = std::tmpfile();
+    if (!file || std::fwrite(chunk.data(), sizeof(point), chunk.size(), file) != chunk.size())
+      fail(std::string("temporary run file: ") + std::strerror(errno));
+    std::rewind(file);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    runs.push_back({file, chunk.size()});
+    counts.duplicates += duplicates;
+    counts.outside += outside.size();
+    for (size_t i = 0; i < outside.size() && counts.outside_examples.size() < 10; ++i)
+      counts.outside_examples.push_back(outside[i]);
+  }
+
+  std::vector<run_file> runs;
+  totals counts;
+
+private:
+  static std::vector<points_pair> row_runs(std::vector<point>::const_iterator first, std::vector<point>::const_iterator last) {
+    std::vector<points_pair> spans;
+    for (auto it = first; it != last; ++it) {
+      if (!spans.empty() && spans.back().second.latitude == it->latitude && spans.back().second.longitude + 1 == it->longitude)
+        spans.back().second = *it;
+      else
+        spans.push_back({*it, *it});
+    }
+    return spans;
+  }
+
+  const validation& v;
+  std::mutex mutex;
+};
+
+// Reads a run back in blocks.
+class run_reader {
+public:
+  explicit run_reader(const run_file& run) : file(run.file), buffer(1 << 14) { refill(); }
+
+  bool done() const { return pos == end; }
+  const point& front() const { return buffer[pos]; }
+
+  void pop() {
+    if (++pos == end)
+      refill();
+  }
+
+private:
+  void refill() {
+    pos = 0;
+    end = std::fread(buffer.data(), sizeof(point), buffer.size(), file);
+  }
+
+  FILE* file;
+  std::vector<point> buffer;
+  size_t pos = 0;
+  size_t end = 0;
+};
+
+// Cuts the merged cells into issuepacked actions that stay within the CPU
+// budget of the issuestep cost model and the NET budget for their cells.
+class action_writer {
+  // three varints of at most ten bytes
+  static constexpr size_t MAX_RUN_BYTES = 30;
+
+public:
+  action_writer(FILE* out, eosio::name contract, uint64_t validation_id, int64_t cpu_budget, size_t net_budget)
+  : out(out), contract(contract), validation_id(validation_id), cpu_budget(cpu_budget), net_budget(net_budget) {
+    start();
+  }
+
+  void push(const point& cell) {
+    auto tile = ertc::nft::tile::key_of(cell);
+    int64_t cost = ertc::ertc::CELL_COST + (tiles.count(tile) ? 0 : ertc::ertc::TILE_COST);
+    // the cell may close the open run and start another one
+    if (count > 0 && (used + cost > cpu_budget || cells->data.size() + 2 * MAX_RUN_BYTES > net_budget)) {
+      flush();
+      cost = ertc::ertc::CELL_COST + ertc::ertc::TILE_COST;
+    }
+    tiles.insert(tile);
+    encoder->push(cell);
+    used += cost;
+    ++count;
+  }
+
+  void finish() {
+    if (count > 0)
+      flush();
+  }
+
+  uint64_t actions = 0;
+  uint64_t issued = 0;
+  size_t largest = 0;
+
+private:
+  void start() {
+    cells = std::make_unique<packed_points>();
+    encoder = std::make_unique<points_encoder>(*cells);
+    tiles.clear();
+    used = 0;
+    count = 0;
+  }
+
+  void flush() {
+    encoder->finish();
+    auto data = eosio::pack(std::make_tuple(validation_id, count, *cells));
+    static const char* hex = "0123456789abcdef";
+    std::string text;
+    text.reserve(2 * data.size());
+    for (char c: data) {
+      text += hex[uint8_t(c) >> 4];
+      text += hex[uint8_t(c) & 0x0f];
+    }
+    std::fprintf(out, "{\"account\":\"%s\",\"name\":\"issuepacked\",\"authorization\":[{\"actor\":\"%s\",\"permission\":\"active\"}],\"cells\":%ld,\"data\":\"%s\"}\n",
+                 contract.to_string().c_str(), contract.to_string().c_str(), count, text.c_str());
+    ++actions;
+    issued += count;
+    largest = std::max(largest, data.size());
+    start();
+  }
+
+  FILE* out;
+  eosio::name contract;
+  uint64_t validation_id;
+  int64_t cpu_budget;
+  size_t net_budget;
+
+  std::unique_ptr<packed_points> cells;
+  std::unique_ptr<points_encoder> encoder;
+  std::unordered_set<uint64_t> tiles;
+  int64_t used = 0;
+  int64_t count = 0;
+};
+
+struct options {
+  std::optional<uint64_t> validation_id;
+  std::string polygon;
+  std::optional<int64_t> amount;
+  std::string cells;
+  std::string out;
+  std::string contract = "ertc";
+  int64_t cpu = ertc::ertc::STEP_BUDGET;
+  size_t net = 16 * 1024;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk = 1 << 20;
+  bool drop_outside = false;
+};
+
+const char* USAGE =
+  "usage: issueprep --validation ID --polygon FILE [--amount N] [--cells FILE]\n"
+  "                 [--out FILE] [--contract NAME] [--cpu UNITS] [--net BYTES]\n"
+  "                 [--threads N] [--chunk CELLS] [--drop-outside]\n";
+
+options parse_options(int argc, char** argv) {
+  options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--drop-outside") {
+      opt.drop_outside = true;
+      continue;
+    }
+    if (i + 1 == argc)
+      fail(USAGE);
+    const char* value = argv[++i];
+    if (arg == "--validation")
+      opt.validation_id = std::strtoull(value, nullptr, 10);
+    else if (arg == "--polygon")
+      opt.polygon = value;
+    else if (arg == "--amount")
+      opt.amount = std::strtoll(value, nullptr, 10);
+    else if (arg == "--cells")
+      opt.cells = value;
+    else if (arg == "--out")
+      opt.out = value;
+    else if (arg == "--contract")
+      opt.contract = value;
+    else if (arg == "--cpu")
+      opt.cpu = std::strtoll(value, nullptr, 10);
+    else if (arg == "--net")
+      opt.net = std::strtoull(value, nullptr, 10);
+    else if (arg == "--threads")
+      opt.threads = std::max(1ull, std::strtoull(value, nullptr, 10));
+    else if (arg == "--chunk")
+      opt.chunk = std::max(1ull, std::strtoull(value, nullptr, 10));
+    else
+      fail(USAGE);
+  }
+  if (!opt.validation_id || opt.polygon.empty())
+    fail(USAGE);
+  if (opt.cpu < ertc::ertc::CELL_COST + ertc::ertc::TILE_COST || opt.net < 64)
+    fail("budget too small for a single cell");
+  return opt;
+}
+
+int run(const options& opt) {
+  validation v{};
+  v.id = *opt.validation_id;
+  v.coordinates = read_polygon(opt.polygon);
+  v.amount = opt.amount.value_or(0);
+  for (const auto& pt: v.coordinates)
+    if (std::abs(pt.latitude) > MAX_RASTER_COORD || std::abs(pt.longitude) > MAX_RASTER_COORD)
+      fail(opt.polygon + ": vertex " + to_string(pt) + " out of range");
+
+  // read and check in parallel, one chunk in the making and one waiting
+  // per worker at most
+  FILE* input = opt.cells.empty() ? stdin : open_file(opt.cells, "rb");
+  chunk_checker checker(v);
+  chunk_queue queue(opt.threads);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < opt.threads; ++i) {
+    workers.emplace_back([&]{
+      while (auto chunk = queue.pop()) {
+        try {
+          checker.check(*chunk);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+        }
+      }
+    });
+  }
+
+  uint64_t read = 0;
+  try {
+    text_source in(input);
+    auto reader = open_reader(in);
+    std::vector<point> chunk;
+    chunk.reserve(opt.chunk);
+    point pt;
+    while (reader->next(pt)) {
+      chunk.push_back(pt);
+      ++read;
+      if (chunk.size() == opt.chunk) {
+        queue.push(std::move(chunk));
+        chunk = {};
+        chunk.reserve(opt.chunk);
+      }
+    }
+    if (!chunk.empty())
+      queue.push(std::move(chunk));
+  } catch (...) {
+    error = std::current_exception();
+  }
+  queue.close();
+  for (auto& w: workers)
+    w.join();
+  if (input != stdin)
+    std::fclose(input);
+  if (error)
+    std::rethrow_exception(error);
+
+  auto& counts = checker.counts;
+  if (counts.outside > 0) {
+    std::fprintf(stderr, "%lu cells outside of the validation polygon, e.g.:\n", counts.outside);
+    for (const auto& pt: counts.outside_examples)
+      std::fprintf(stderr, "  %s\n", to_string(pt).c_str());
+    if (!opt.drop_outside)
+      fail("cells outside of the validation polygon");
+  }
+
+  // merge the runs; the output only appears once every check passed
+  std::string partial = opt.out.empty() ? std::string() : opt.out + ".part";
+  FILE* out = opt.out.empty() ? stdout : open_file(partial, "wb");
+  action_writer writer(out, eosio::name(opt.contract), v.id, opt.cpu, opt.net);
+
+  std::vector<run_reader> readers;
+  readers.reserve(checker.runs.size());
+  for (const auto& run: checker.runs)
+    readers.emplace_back(run);
+  auto later = [&](size_t a, size_t b){ return row_major(readers[b].front(), readers[a].front()); };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+  for (size_t i = 0; i < readers.size(); ++i)
+    if (!readers[i].done())
+      heads.push(i);
+
+  std::optional<point> last;
+  uint64_t duplicates = counts.duplicates;
+  while (!heads.empty()) {
+    size_t i = heads.top();
+    heads.pop();
+    point cell = readers[i].front();
+    readers[i].pop();
+    if (!readers[i].done())
+      heads.push(i);
+
+    if (last && same_cell(*last, cell)) {
+      ++duplicates;
+      continue;
+    }
+    last = cell;
+    writer.push(cell);
+  }
+  writer.finish();
+  for (const auto& run: checker.runs)
+    std::fclose(run.file);
+
+  std::fprintf(stderr, "%lu cells read, %lu duplicates, %lu outside, %lu to issue in %lu actions, largest %zu bytes\n",
+               read, duplicates, counts.outside, writer.issued, writer.actions, writer.largest);
+
+  bool amount_ok = !opt.amount || *opt.amount == int64_t(writer.issued);
+  if (out != stdout) {
+    std::fclose(out);
+    if (amount_ok && std::rename(partial.c_str(), opt.out.c_str()) != 0)
+      fail(opt.out + ": " + std::strerror(errno));
+    if (!amount_ok)
+      std::remove(partial.c_str());
+  }
+  if (!amount_ok)
+    fail("amount is " + std::to_string(*opt.amount) + " but there are " + std::to_string(writer.issued) + " cells");
+  return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+  try {
+    return run(parse_options(argc, argv));
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "issueprep: %s\n", e.what());
+    return 1;
+  }
+}